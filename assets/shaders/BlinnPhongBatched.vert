@@ -0,0 +1,33 @@
+#version 430
+
+// Input data
+layout ( location = 0 ) in vec3 iPosition;
+layout ( location = 1 ) in vec3 iNormal;
+// Per draw: index of the material in the batch and rows of the affine model2world matrix
+layout ( location = 2 ) in int iMaterialIndex;
+layout ( location = 3 ) in vec4 iModel2worldRow0;
+layout ( location = 4 ) in vec4 iModel2worldRow1;
+layout ( location = 5 ) in vec4 iModel2worldRow2;
+// Rows of its normal matrix, the transpose of the inverse of the 3x3 part, computed on the CPU
+layout ( location = 6 ) in vec3 iNormalRow0;
+layout ( location = 7 ) in vec3 iNormalRow1;
+layout ( location = 8 ) in vec3 iNormalRow2;
+
+// Uniform data
+layout( location = 0 ) uniform mat4 uWorld2projection;
+
+out vec3 v2fWorldPosition;
+out vec3 v2fNormal;
+flat out int v2fMaterialIndex;
+
+void main()
+{
+	mat4 model2world = transpose(mat4(iModel2worldRow0, iModel2worldRow1, iModel2worldRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+	mat3 normalMatrix = transpose(mat3(iNormalRow0, iNormalRow1, iNormalRow2));
+	v2fNormal = normalize(normalMatrix * iNormal);
+	vec4 worldPosition = model2world * vec4( iPosition.xyz, 1.0 );
+	v2fWorldPosition = worldPosition.xyz;
+	v2fMaterialIndex = iMaterialIndex;
+	// Copy position to the built-in gl Position attribute
+	gl_Position = uWorld2projection * worldPosition;
+}
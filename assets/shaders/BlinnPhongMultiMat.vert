@@ -3,11 +3,16 @@
 // Input data
 layout ( location = 0 ) in vec3 iPosition;
 layout ( location = 1 ) in vec3 iNormal;
-layout ( location = 2 ) in int iMaterialIndex;
 
 // Uniform data
 layout( location = 0 ) uniform mat4 uWorld2projection;
 layout( location = 1 ) uniform mat4 uModel2world;
+// Transpose of the inverse of the 3x3 part of uModel2world, computed once per draw on the CPU
+layout( location = 74 ) uniform mat3 uNormalMatrix;
+
+// The vertices are grouped by material: uMaterialEnds[i] is one past the last vertex of material i
+layout( location = 63 ) uniform int uMaterialCount;
+layout( location = 64 ) uniform int uMaterialEnds[10];
 
 out vec3 v2fWorldPosition;
 out vec3 v2fNormal;
@@ -15,11 +20,13 @@ flat out int v2fMaterialIndex;
 
 void main()
 {
-	mat3 normalMatrix = mat3(transpose(inverse(uModel2world)));
-	v2fNormal = normalize(normalMatrix * iNormal);
+	v2fNormal = normalize(uNormalMatrix * iNormal);
 	vec4 worldPosition = uModel2world * vec4( iPosition.xyz, 1.0 );
 	v2fWorldPosition = worldPosition.xyz;
-	v2fMaterialIndex = iMaterialIndex;
+	int materialIndex = 0;
+	while (materialIndex < uMaterialCount - 1 && gl_VertexID >= uMaterialEnds[materialIndex])
+		materialIndex++;
+	v2fMaterialIndex = materialIndex;
 	// Copy position to the built-in gl Position attribute
 	gl_Position = uWorld2projection * worldPosition;
 }
@@ -0,0 +1,40 @@
+#version 430
+
+// Input data
+layout ( location = 0 ) in vec3 iPosition;
+layout ( location = 1 ) in vec3 iNormal;
+// Rows of the model2world matrix of the instance, rigid so that its 3x3 part is also the normal matrix
+layout ( location = 3 ) in vec4 iModel2worldRow0;
+layout ( location = 4 ) in vec4 iModel2worldRow1;
+layout ( location = 5 ) in vec4 iModel2worldRow2;
+// Tail animation of the instance: phase (in turns) and amplitude
+layout ( location = 6 ) in vec2 iTail;
+
+// Uniform data
+layout( location = 0 ) uniform mat4 uWorld2projection;
+
+// The vertices are grouped by material: uMaterialEnds[i] is one past the last vertex of material i
+layout( location = 63 ) uniform int uMaterialCount;
+layout( location = 64 ) uniform int uMaterialEnds[10];
+
+out vec3 v2fWorldPosition;
+out vec3 v2fNormal;
+flat out int v2fMaterialIndex;
+
+void main()
+{
+	mat4 model2world = transpose(mat4(iModel2worldRow0, iModel2worldRow1, iModel2worldRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+	// The tail wags by shearing z by x (the model faces +X), the normals by the inverse transpose
+	float shear = iTail.y * sin(6.28318531 * iTail.x);
+	vec3 position = vec3(iPosition.x, iPosition.y, iPosition.z + shear * iPosition.x);
+	vec3 normal = vec3(iNormal.x - shear * iNormal.z, iNormal.y, iNormal.z);
+	v2fNormal = normalize(mat3(model2world) * normal);
+	vec4 worldPosition = model2world * vec4( position, 1.0 );
+	v2fWorldPosition = worldPosition.xyz;
+	int materialIndex = 0;
+	while (materialIndex < uMaterialCount - 1 && gl_VertexID >= uMaterialEnds[materialIndex])
+		materialIndex++;
+	v2fMaterialIndex = materialIndex;
+	// Copy position to the built-in gl Position attribute
+	gl_Position = uWorld2projection * worldPosition;
+}
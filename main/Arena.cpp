@@ -0,0 +1,80 @@
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+
+namespace {
+    // All the arenas alive, used to report the totals in the GUI
+    std::mutex registryMutex;
+    std::vector<Arena*> registry;
+}
+
+std::atomic<uint64_t> Arena::tickCounter{ 1 };
+
+Arena::Arena()
+{
+    addBlock(DEFAULT_BLOCK_SIZE);
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry.push_back(this);
+}
+
+Arena::~Arena()
+{
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.erase(std::find(registry.begin(), registry.end(), this));
+    }
+    for (Block& block : this->blocks)
+        ::operator delete(block.data, std::align_val_t(BLOCK_ALIGNMENT));
+}
+
+Arena& Arena::local()
+{
+    thread_local Arena arena;
+    return arena;
+}
+
+void Arena::beginTick()
+{
+    tickCounter.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Arena::totals(std::size_t& used, std::size_t& reserved)
+{
+    used = 0;
+    reserved = 0;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (Arena* arena : registry) {
+        used += arena->used.load(std::memory_order_relaxed);
+        reserved += arena->reserved.load(std::memory_order_relaxed);
+    }
+}
+
+void Arena::addBlock(std::size_t bytes)
+{
+    std::size_t size = std::max(bytes, DEFAULT_BLOCK_SIZE);
+    unsigned char* data = static_cast<unsigned char*>(::operator new(size, std::align_val_t(BLOCK_ALIGNMENT)));
+    this->blocks.insert(this->blocks.begin() + this->current, Block{ data, size });
+    this->reserved.store(this->reserved.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+}
+
+void Arena::reset()
+{
+    this->peak = std::max(this->peak, this->used.load(std::memory_order_relaxed));
+
+    // The last tick needed more than one block: replace them with a single block
+    // big enough for the peak, so the following ticks stay in one block
+    if (this->current > 0) {
+        for (Block& block : this->blocks)
+            ::operator delete(block.data, std::align_val_t(BLOCK_ALIGNMENT));
+        this->blocks.clear();
+        this->reserved.store(0, std::memory_order_relaxed);
+        this->current = 0;
+        addBlock(this->peak + this->peak / 2);
+    }
+
+    this->current = 0;
+    this->offset = 0;
+    this->used.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+* @brief Bump allocator for the short-lived data of a simulation tick.
+* Every thread owns one arena (Arena::local()). Allocating only moves a pointer,
+* freeing does nothing, and everything is released at once when a new tick begins.
+* When a tick overflows the first block, the blocks are merged into one bigger block
+* on the next reset, so the steady state is a single block and no allocator traffic.
+*/
+class Arena {
+private:
+	static constexpr std::size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+	static constexpr std::size_t BLOCK_ALIGNMENT = 64;
+
+	struct Block {
+		unsigned char* data;
+		std::size_t size;
+	};
+
+	static std::atomic<uint64_t> tickCounter;
+
+	std::vector<Block> blocks;
+	std::size_t current = 0;	// index of the block being filled
+	std::size_t offset = 0;		// offset in the current block
+	uint64_t tick = 0;			// tick this arena was last reset for
+
+	// Written by the owning thread only, atomic so that totals() can read them from any thread
+	std::atomic<std::size_t> used{ 0 };		// bytes handed out since the last reset
+	std::atomic<std::size_t> reserved{ 0 };	// bytes of all the blocks
+	std::size_t peak = 0;					// highest value of used over all the ticks
+
+	/**
+	* @brief Adds a block that can hold at least the given number of bytes.
+	*
+	* @param bytes - The minimum size of the new block.
+	*
+	* @return void
+	*/
+	void addBlock(std::size_t);
+
+	/**
+	* @brief Releases all the allocations, merging the blocks if more than one was needed.
+	*
+	* @return void
+	*/
+	void reset();
+
+	Arena();
+
+public:
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+	~Arena();
+
+	/**
+	* @brief Returns the arena of the calling thread.
+	*/
+	static Arena& local();
+
+	/**
+	* @brief Starts a new simulation tick: the arena of every thread is reset
+	* the next time that thread allocates from it.
+	*
+	* @return void
+	*/
+	static void beginTick();
+
+	/**
+	* @brief Sums the bytes used in the current tick and reserved by the arenas of all threads.
+	*
+	* @param used - Set to the bytes handed out during the current tick.
+	* @param reserved - Set to the bytes owned by the arenas.
+	*
+	* @return void
+	*/
+	static void totals(std::size_t&, std::size_t&);
+
+	/**
+	* @brief Allocates memory that lives until the next tick begins.
+	*
+	* @param bytes - The size of the allocation.
+	* @param alignment - The alignment of the allocation, a power of two up to BLOCK_ALIGNMENT.
+	*
+	* @return Pointer to the allocated memory.
+	*/
+	void* allocate(std::size_t bytes, std::size_t alignment) {
+		uint64_t currentTick = tickCounter.load(std::memory_order_relaxed);
+		if (this->tick != currentTick) {
+			reset();
+			this->tick = currentTick;
+		}
+
+		// Blocks are aligned to BLOCK_ALIGNMENT, so aligning the offset aligns the address
+		std::size_t aligned = (this->offset + alignment - 1) & ~(alignment - 1);
+		if (aligned + bytes > this->blocks[this->current].size) {
+			// Use the next block if it is big enough, otherwise add one
+			this->current++;
+			if (this->current == this->blocks.size() || bytes > this->blocks[this->current].size)
+				addBlock(bytes);
+			aligned = 0;
+		}
+		this->offset = aligned + bytes;
+		this->used.store(this->used.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+		return this->blocks[this->current].data + aligned;
+	}
+};
+
+/**
+* @brief Standard allocator adapter that takes its memory from the arena of the allocating thread.
+*/
+template<class T>
+class ArenaAllocator {
+public:
+	using value_type = T;
+
+	ArenaAllocator() noexcept {};
+	template<class U>
+	ArenaAllocator(ArenaAllocator<U> const&) noexcept {};
+
+	T* allocate(std::size_t count) {
+		return static_cast<T*>(Arena::local().allocate(count * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T*, std::size_t) noexcept {};
+
+	template<class U>
+	bool operator==(ArenaAllocator<U> const&) const noexcept {
+		return true;
+	}
+
+	template<class U>
+	bool operator!=(ArenaAllocator<U> const&) const noexcept {
+		return false;
+	}
+};
+
+/**
+* @brief A vector whose storage lives in the per-thread arena, valid until the next tick begins.
+*/
+template<class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
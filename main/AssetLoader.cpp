@@ -0,0 +1,58 @@
+#include "AssetLoader.hpp"
+
+#include <chrono>
+#include <limits>
+
+AssetLoader::~AssetLoader()
+{
+    for (JobSystem::JobHandle const& decode : this->decodes)
+        this->jobs.wait(decode);
+}
+
+void AssetLoader::load(Decode decode, std::vector<JobSystem::JobHandle> const& dependencies)
+{
+    this->total++;
+    this->decodes.push_back(this->jobs.submit([this, decode = std::move(decode)]() {
+        Upload upload = decode();
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->ready.push_back(std::move(upload));
+    }, dependencies, JobSystem::Queue::Background));
+}
+
+void AssetLoader::loadAll()
+{
+    for (JobSystem::JobHandle const& decode : this->decodes)
+        this->jobs.wait(decode);
+    while (!finished())
+        pumpUploads(std::numeric_limits<double>::infinity());
+}
+
+std::size_t AssetLoader::pumpUploads(double budgetMs)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::size_t count = 0;
+
+    // Without pool threads the decodes only progress here, one per frame
+    if (this->jobs.threadCount() == 1)
+        this->jobs.runBackground();
+
+    while (true) {
+        Upload upload;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (this->ready.empty())
+                break;
+            upload = std::move(this->ready.front());
+            this->ready.pop_front();
+        }
+        if (upload)
+            upload();
+        this->uploaded++;
+        count++;
+
+        std::chrono::duration<double, std::milli> spent = std::chrono::steady_clock::now() - start;
+        if (spent.count() >= budgetMs)
+            break;
+    }
+    return count;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "JobSystem.hpp"
+
+/**
+* @brief Streams the assets of the scene in while the application is already running.
+* Every asset is decoded by a background job on the JobSystem (file reads, image decoding, mesh building),
+* which hands back the GL part of the work (buffer and texture uploads, shader compilation).
+* That part waits in a queue until the thread owning the GL context picks it up between frames,
+* so the window shows its first frame at once and the scene fills in as the assets arrive.
+*/
+class AssetLoader {
+public:
+	// GL work finishing an asset, run on the context thread
+	using Upload = std::function<void()>;
+
+	// CPU work of an asset, run on any thread, returning the GL work left to do
+	using Decode = std::function<Upload()>;
+
+private:
+	JobSystem& jobs;
+	std::vector<JobSystem::JobHandle> decodes;
+
+	std::mutex mutex;			// guards ready
+	std::deque<Upload> ready;	// uploads of the decoded assets, oldest first
+
+	std::size_t total = 0;
+	std::size_t uploaded = 0;
+
+public:
+	AssetLoader() : jobs(JobSystem::get()) {}
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	/**
+	* @brief Waits for the decodes still running, since they write into the caller's variables.
+	* The uploads not run yet are dropped.
+	*/
+	~AssetLoader();
+
+	/**
+	* @brief Queues the loading of an asset. Must be called from the context thread.
+	*
+	* @param decode - The CPU work of the asset, returning its GL work (or an empty function).
+	* @param dependencies - Jobs that must finish before the decode starts, e.g. the decoding of its parts,
+	* best submitted to the background queue too.
+	*
+	* @return void
+	*/
+	void load(Decode, std::vector<JobSystem::JobHandle> const& dependencies = {});
+
+	/**
+	* @brief Runs the uploads of the decoded assets on the calling thread, which must own the GL context.
+	* Stops once the budget is spent, after at least one upload, so that a frame is not held up by a
+	* burst of assets finishing together. Without pool threads, also runs one decode.
+	*
+	* @param budgetMs - The time the uploads may take, in milliseconds.
+	*
+	* @return std::size_t The number of uploads run.
+	*/
+	std::size_t pumpUploads(double);
+
+	/**
+	* @brief Waits for every queued asset and runs all the uploads on the calling thread, which must
+	* own the GL context. The thread runs jobs while it waits, so this also works without pool threads.
+	*
+	* @return void
+	*/
+	void loadAll();
+
+	/**
+	* @brief Number of assets queued since the start.
+	*/
+	std::size_t assetCount() const {
+		return this->total;
+	}
+
+	/**
+	* @brief Number of assets decoded and uploaded.
+	*/
+	std::size_t loadedCount() const {
+		return this->uploaded;
+	}
+
+	/**
+	* @brief Whether every queued asset is decoded and uploaded.
+	*/
+	bool finished() const {
+		return this->uploaded == this->total;
+	}
+};
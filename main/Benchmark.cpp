@@ -0,0 +1,148 @@
+#include "Benchmark.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "Flock.hpp"
+#include "Obstacle.hpp"
+#include "Profiler.hpp"
+#include "SimulationBounds.hpp"
+
+namespace {
+    struct BenchmarkCase {
+        const char* name;
+        void (*configure)(FlockSettings&);
+        uint32_t species;   // the boids are split evenly between this many species
+    };
+
+    const BenchmarkCase CASES[] = {
+        { "grid search", [](FlockSettings&) {}, 1 },
+        { "morton sort every tick", [](FlockSettings& s) { s.sortInterval = 1; }, 1 },
+        { "morton sort every 10 ticks", [](FlockSettings& s) { s.sortInterval = 10; }, 1 },
+        { "morton sort every 60 ticks", [](FlockSettings& s) { s.sortInterval = 60; }, 1 },
+        { "verlet lists", [](FlockSettings& s) { s.verletLists = true; }, 1 },
+        { "verlet lists, morton sort every 60 ticks", [](FlockSettings& s) { s.verletLists = true; s.sortInterval = 60; }, 1 },
+        { "topological, 7 nearest neighbours", [](FlockSettings& s) { s.topological = true; }, 1 },
+        { "2 species, ignoring each other", [](FlockSettings&) {}, 2 },
+        { "2 species, interacting", [](FlockSettings& s) { s.interaction[0][1] = s.interaction[1][0] = 0.5f; }, 2 },
+        { "2 species, prey fleeing predators", [](FlockSettings& s) { s.species[1].predator = true; s.interaction[1][0] = 1.f; }, 2 },
+    };
+
+    // Opening angles of the approximate neighbour search compared with the exact one
+    const float OPENING_ANGLES[] = { 0.5f, 1.f, 1.5f, 2.f };
+
+    // Boids in the default volume at density 1, the default scene
+    constexpr float DEFAULT_BOIDS = 1000.f;
+
+    constexpr float TICK = 1.f / 60.f;
+    constexpr int WARMUP_TICKS = 10;
+
+    // Runs ticks of the flock, returns the mean, fastest and slowest tick in ms
+    void timeTicks(Flock& flock, FlockSettings const& settings, std::vector<Obstacle*> const& obstacles, int ticks,
+        double& mean, double& fastest, double& slowest)
+    {
+        Profiler& profiler = Profiler::get();
+        double total = 0.0;
+        fastest = 1e30;
+        slowest = 0.0;
+        for (int t = 0; t < ticks; t++) {
+            int64_t start = profiler.now();
+            flock.update(TICK, settings, obstacles);
+            double ms = (profiler.now() - start) / 1e6;
+            profiler.endFrame();
+
+            total += ms;
+            if (ms < fastest) fastest = ms;
+            if (ms > slowest) slowest = ms;
+        }
+        mean = total / ticks;
+    }
+}
+
+int runBenchmark(int argc, char** argv)
+{
+    int boidCount = argc > 0 ? atoi(argv[0]) : 10000;
+    int ticks = argc > 1 ? atoi(argv[1]) : 300;
+    float density = argc > 2 ? (float)atof(argv[2]) : 1.f;
+    if (boidCount <= 0 || ticks <= 0 || density <= 0.f) {
+        printf("Usage: main --benchmark [boids] [ticks] [density, 1 = the default scene]\n");
+        return 1;
+    }
+
+    // Density relative to the default scene with 1000 boids, without obstacles
+    SimulationBounds reference;
+    SimulationBounds bounds = SimulationBounds::withDensity(reference, boidCount, density * DEFAULT_BOIDS / reference.volume());
+    std::vector<Obstacle*> obstacles;
+    Profiler& profiler = Profiler::get();
+
+    Vec3f size = bounds.size();
+    printf("%d boids, %d ticks of %.1f ms, density %.2f, volume %.0f x %.0f x %.0f\n", boidCount, ticks, TICK * 1000.f, density, size.x, size.y, size.z);
+    printf("%-44s %10s %10s %10s\n", "case", "mean ms", "min ms", "max ms");
+    for (BenchmarkCase const& benchmark : CASES) {
+        FlockSettings settings;
+        benchmark.configure(settings);
+
+        // Every case starts from the same flock
+        srand(1);
+        Flock flock(bounds);
+        for (uint32_t species = 0; species < benchmark.species; species++)
+            flock.resize(species, boidCount / benchmark.species + ((int)species < boidCount % (int)benchmark.species ? 1 : 0), obstacles);
+        for (int t = 0; t < WARMUP_TICKS; t++) {
+            flock.update(TICK, settings, obstacles);
+            profiler.endFrame();
+        }
+
+        double mean, fastest, slowest;
+        timeTicks(flock, settings, obstacles, ticks, mean, fastest, slowest);
+        printf("%-44s %10.3f %10.3f %10.3f\n", benchmark.name, mean, fastest, slowest);
+    }
+
+    // Approximate neighbour search against the exact one, both timed from the same state. The error is the
+    // angle between the target directions given by the exact and the approximate rules to every boid, over one tick
+    FlockSettings exact;
+    srand(1);
+    Flock start(bounds);
+    start.resize(0, boidCount, obstacles);
+    for (int t = 0; t < WARMUP_TICKS; t++) {
+        start.update(TICK, exact, obstacles);
+        profiler.endFrame();
+    }
+
+    double exactMean, fastest, slowest;
+    {
+        Flock flock = start;
+        timeTicks(flock, exact, obstacles, ticks, exactMean, fastest, slowest);
+    }
+    printf("\n%-44s %10s %10s %10s %10s %12s %12s\n", "neighbour search", "mean ms", "min ms", "max ms", "vs exact", "mean err deg", "max err deg");
+    printf("%-44s %10.3f %10.3f %10.3f %10.2f %12.3f %12.3f\n", "exact", exactMean, fastest, slowest, 1.0, 0.0, 0.0);
+
+    Flock expectedFlock = start;
+    expectedFlock.update(TICK, exact, obstacles);
+    profiler.endFrame();
+    std::vector<Boid> const& expected = expectedFlock.pool(0).all();
+    for (float openingAngle : OPENING_ANGLES) {
+        FlockSettings approximate;
+        approximate.approximate = true;
+        approximate.openingAngle = openingAngle;
+
+        Flock flock = start;
+        flock.update(TICK, approximate, obstacles);
+        profiler.endFrame();
+        std::vector<Boid> const& actual = flock.pool(0).all();
+        double errorSum = 0.0, errorMax = 0.0;
+        for (std::size_t i = 0; i < actual.size(); i++) {
+            float cosine = dot(normalize(expected[i].getTargetDirection()), normalize(actual[i].getTargetDirection()));
+            double error = degrees(acos(clamp(cosine, -1.f, 1.f)));
+            errorSum += error;
+            if (error > errorMax) errorMax = error;
+        }
+
+        double mean;
+        timeTicks(flock, approximate, obstacles, ticks, mean, fastest, slowest);
+        char name[64];
+        snprintf(name, sizeof(name), "approximate, opening angle %.2f", openingAngle);
+        printf("%-44s %10.3f %10.3f %10.3f %10.2f %12.3f %12.3f\n", name, mean, fastest, slowest, exactMean / mean, errorSum / actual.size(), errorMax);
+    }
+    return 0;
+}
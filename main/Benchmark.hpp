@@ -0,0 +1,14 @@
+#pragma once
+
+/**
+* @brief Runs the simulation without a window or GL context, once per benchmark case, and
+* prints the time per tick of each case. The approximate neighbour search is then compared with the exact
+* one at several opening angles, by time and by error against the exact rules. The density is relative to
+* the default scene with 1000 boids. Started with: main --benchmark [boids] [ticks] [density]
+*
+* @param argc - The number of arguments after --benchmark.
+* @param argv - The arguments after --benchmark.
+*
+* @return int The exit code of the application.
+*/
+int runBenchmark(int, char**);
@@ -1,19 +1,9 @@
 #include "Boid.hpp"
 
-void Boid::updateDirection(float speed, float transition) {
-	// Rotation on custom axis from object's original direction to currentDirection
-	float rotationAngle = acos(dot(this->initialDirection, this->currentDirection));
-	Vec3f rotationAxis = normalize(cross(this->initialDirection, this->currentDirection));
-	if (rotationAngle <= radians(90)) {
-		this->rotationMatrix = make_rotation_custom_axis(rotationAxis, rotationAngle);
-	}
-	// If the angle is greater than 90 deg, we need to reverse the rotation to avoid the fish swimming upside down due to the normal rotation.
-	else {
-		this->rotationMatrix = make_rotation_custom_axis(rotationAxis, -(radians(180) - rotationAngle)) * make_rotation_y(radians(180));
-	}
-
-	// Translation using different types of linear interpolation
+#include <algorithm>
+#include <utility>
 
+void Boid::updateDirection(float speed, float transition, SimulationBounds const& bounds) {
 	// Compute the angle between the vectors
 	float angle = degrees(acos(dot(this->currentDirection, this->targetDirection)));
 
@@ -30,44 +20,111 @@ void Boid::updateDirection(float speed, float transition) {
 	else {
 		this->currentDirection = normalize(lerp(this->currentDirection, this->targetDirection, transition));
 	}
-	this->currentPosition += this->currentDirection * speed;
-	this->translationMatrix = make_translation(currentPosition);
+	this->currentPosition = bounds.wrap(this->currentPosition + this->currentDirection * speed);
+}
 
-	// Update model2world
-	this->model2world = this->translationMatrix * this->rotationMatrix;
+void Boid::findNeighbours(SpatialGrid const& grid, std::vector<Boid>& totalBoids, SimulationBounds const& bounds, float radius, float visionAngle, float margin, ArenaVector<Boid*>& neighbours) {
+	grid.forEachCandidate(this->currentPosition, radius + margin, [&](uint32_t index) {
+		Boid* b = &totalBoids[index];
+		if (isNeighbour(*b, bounds, radius, visionAngle)) {
+			neighbours.push_back(b);
+		}
+	});
 }
 
-std::vector<Boid*> Boid::findNeighbours(std::vector<Boid*> totalBoids, float radius, float visionAngle) {
-	std::vector<Boid*> neighbours;
-	float distance;
-	for (auto b : totalBoids) {
-		Vec3f diff = b->currentPosition - this->currentPosition;
-		distance = length(diff);
-		if (distance > 0 && distance < radius) {
-			float angle = acos(dot(this->currentDirection, diff));
-			if (angle < visionAngle) {
-				neighbours.push_back(b);
-			}
+void Boid::filterNeighbours(uint32_t const* candidates, std::size_t count, std::vector<Boid>& totalBoids, SimulationBounds const& bounds, float radius, float visionAngle, ArenaVector<Boid*>& neighbours) {
+	for (std::size_t i = 0; i < count; i++) {
+		Boid* b = &totalBoids[candidates[i]];
+		if (isNeighbour(*b, bounds, radius, visionAngle)) {
+			neighbours.push_back(b);
 		}
 	}
-	return neighbours;
 }
 
-Vec3f Boid::applyCohesion(std::vector<Boid*> neighbours, float strength) {
+void Boid::findNearestNeighbours(SpatialGrid const& grid, std::vector<Boid>& totalBoids, SimulationBounds const& bounds, float radius, float visionAngle, float margin, std::size_t k,
+	ArenaVector<std::pair<float, uint32_t>>& nearest, ArenaVector<Boid*>& neighbours) {
+	if (k == 0) {
+		return;
+	}
+
+	// Max-heap of the squared distances of the k nearest visible boids found so far
+	nearest.clear();
+	nearest.reserve(k);
+	float radius2 = radius * radius;
+	grid.forEachCandidateByRing(this->currentPosition,
+		[&](uint32_t index) {
+			Vec3f diff = bounds.displacement(this->currentPosition, totalBoids[index].currentPosition);
+			float distance2 = dot(diff, diff);
+			// The distance test is cheaper than the vision test, so it comes first
+			if (distance2 >= radius2 || (nearest.size() == k && distance2 >= nearest.front().first) || !sees(diff, radius, visionAngle)) {
+				return;
+			}
+			if (nearest.size() == k) {
+				std::pop_heap(nearest.begin(), nearest.end());
+				nearest.pop_back();
+			}
+			nearest.emplace_back(distance2, index);
+			std::push_heap(nearest.begin(), nearest.end());
+		},
+		[&](float distance) {
+			// The boids of the next ring may have come closer by the margin since the grid was built
+			float reach = distance - margin;
+			if (reach >= radius) {
+				return false;
+			}
+			return nearest.size() < k || reach <= 0.f || reach * reach < nearest.front().first;
+		});
+
+	for (std::pair<float, uint32_t> const& n : nearest) {
+		neighbours.push_back(&totalBoids[n.second]);
+	}
+}
+
+void Boid::sampleNeighbours(SpatialGrid const& grid, std::vector<Boid>& totalBoids, SimulationBounds const& bounds, float radius, float visionAngle, float margin, float openingAngle, ArenaVector<NeighbourSample>& samples) {
+	grid.forEachSample(this->currentPosition, radius + margin, openingAngle,
+		[&](uint32_t index) {
+			Boid const& b = totalBoids[index];
+			Vec3f diff = bounds.displacement(this->currentPosition, b.currentPosition);
+			if (sees(diff, radius, visionAngle)) {
+				samples.push_back(NeighbourSample{ diff, b.currentDirection, 1.f });
+			}
+		},
+		[&](SpatialGrid::Aggregate const& block, Vec3f offset) {
+			if (sees(offset, radius, visionAngle)) {
+				samples.push_back(NeighbourSample{ offset, block.directionSum, (float)block.count });
+			}
+		});
+}
+
+Vec3f Boid::applyCohesion(ArenaVector<Boid*> const& neighbours, float strength, SimulationBounds const& bounds) {
 	if (neighbours.size() == 0) {
 		return Vec3f{ 0.f, 0.f, 0.f };
 	}
 
 	Vec3f cohesion = Vec3f{ 0.f, 0.f, 0.f };
+	// Average offset to the neighbours, i.e. the centre of mass relative to this boid
 	for (Boid* b : neighbours) {
-		cohesion += b->currentPosition;
+		cohesion += bounds.displacement(this->currentPosition, b->currentPosition);
 	}
 	cohesion /= (float)neighbours.size();
-	cohesion -= this->currentPosition;
 	return normalize(cohesion) * strength;
 }
 
-Vec3f Boid::applyAlignment(std::vector<Boid*> neighbours, float strength) {
+Vec3f Boid::applyCohesion(ArenaVector<NeighbourSample> const& samples, float strength) {
+	Vec3f cohesion = Vec3f{ 0.f, 0.f, 0.f };
+	float weight = 0.f;
+	for (NeighbourSample const& s : samples) {
+		cohesion += s.offset * s.weight;
+		weight += s.weight;
+	}
+	if (weight == 0.f) {
+		return Vec3f{ 0.f, 0.f, 0.f };
+	}
+	cohesion /= weight;
+	return normalize(cohesion) * strength;
+}
+
+Vec3f Boid::applyAlignment(ArenaVector<Boid*> const& neighbours, float strength) {
 	if (neighbours.size() == 0) {
 		return Vec3f{ 0.f, 0.f, 0.f };
 	}
@@ -80,14 +137,27 @@ Vec3f Boid::applyAlignment(std::vector<Boid*> neighbours, float strength) {
 	return normalize(alignment) * strength;
 }
 
-Vec3f Boid::applySeparation(std::vector<Boid*> neighbours, float strength, float radius) {
+Vec3f Boid::applyAlignment(ArenaVector<NeighbourSample> const& samples, float strength) {
+	if (samples.size() == 0) {
+		return Vec3f{ 0.f, 0.f, 0.f };
+	}
+
+	Vec3f alignment = Vec3f{ 0.f, 0.f, 0.f };
+	for (NeighbourSample const& s : samples) {
+		alignment += s.direction;
+	}
+	return normalize(alignment) * strength;
+}
+
+Vec3f Boid::applySeparation(ArenaVector<Boid*> const& neighbours, float strength, float radius, SimulationBounds const& bounds) {
 	if (neighbours.size() == 0) {
 		return Vec3f{ 0.f, 0.f, 0.f };
 	}
 
-	std::vector<Boid*> closeNeighbours;
+	ArenaVector<Boid*> closeNeighbours;
+	closeNeighbours.reserve(neighbours.size());
 	for (Boid* b : neighbours) {
-		if (length(b->currentPosition - this->currentPosition) < radius / 2) {
+		if (length(bounds.displacement(this->currentPosition, b->currentPosition)) < radius / 2) {
 			closeNeighbours.push_back(b);
 		}
 	}
@@ -99,39 +169,61 @@ Vec3f Boid::applySeparation(std::vector<Boid*> neighbours, float strength, float
 	Vec3f separation = Vec3f{ 0.f, 0.f, 0.f };
 
 	for (Boid* b : closeNeighbours) {
-		separation += this->currentPosition - b->currentPosition;
+		separation -= bounds.displacement(this->currentPosition, b->currentPosition);
 	}
 	separation /= (float)closeNeighbours.size();
 	return normalize(separation) * strength;
 }
 
+Vec3f Boid::applySeparation(ArenaVector<NeighbourSample> const& samples, float strength, float radius) {
+	Vec3f separation = Vec3f{ 0.f, 0.f, 0.f };
+	float weight = 0.f;
+	for (NeighbourSample const& s : samples) {
+		if (length(s.offset) < radius / 2) {
+			separation -= s.offset * s.weight;
+			weight += s.weight;
+		}
+	}
+	if (weight == 0.f) {
+		return Vec3f{ 0.f, 0.f, 0.f };
+	}
+	separation /= weight;
+	return normalize(separation) * strength;
+}
+
 // turns back when reaching the edge of the simulation
-Vec3f Boid::avoidEdges(float strength) {
+Vec3f Boid::avoidEdges(SimulationBounds const& bounds, float strength) {
 	Vec3f direction = Vec3f{ 0.f, 0.f, 0.f };
-	if (this->currentPosition.x < X_MIN) {
+	if (bounds.periodic) {
+		return direction;
+	}
+
+	Vec3f low = bounds.innerMin();
+	Vec3f high = bounds.innerMax();
+	if (this->currentPosition.x < low.x) {
 		direction.x += 1.f;
 	}
-	else if (this->currentPosition.x > X_MAX) {
+	else if (this->currentPosition.x > high.x) {
 		direction.x -= 1.f;
 	}
 
-	if (this->currentPosition.y < Y_MIN) {
+	if (this->currentPosition.y < low.y) {
 		direction.y += 1.f;
 	}
-	else if (this->currentPosition.y > Y_MAX) {
+	else if (this->currentPosition.y > high.y) {
 		direction.y -= 1.f;
 	}
 
-	if (this->currentPosition.z < Z_MIN) {
+	if (this->currentPosition.z < low.z) {
 		direction.z += 1.f;
 	}
-	else if (this->currentPosition.z > Z_MAX) {
+	else if (this->currentPosition.z > high.z) {
 		direction.z -= 1.f;
 	}
 	return direction * strength;
 }
 
-Vec3f Boid::avoidObstacles(std::vector<Obstacle*> obstacles, float strength) {
+Vec3f Boid::avoidObstacles(std::vector<Obstacle*> const& obstacles, float strength) {
 	Vec3f direction = Vec3f{ 0.f, 0.f, 0.f };
 	for (auto o : obstacles) {
 		if (o->isColliding(this->currentPosition)) {
@@ -139,4 +231,23 @@ Vec3f Boid::avoidObstacles(std::vector<Obstacle*> obstacles, float strength) {
 		}
 	}
 	return normalize(direction) * strength;
-}
\ No newline at end of file
+}
+
+Vec3f Boid::fleePredators(SpatialGrid const& grid, std::vector<Boid> const& predators, SimulationBounds const& bounds, float fearRadius, float strength, float margin) {
+	Vec3f direction = Vec3f{ 0.f, 0.f, 0.f };
+	float fearRadius2 = fearRadius * fearRadius;
+	grid.forEachCandidate(this->currentPosition, fearRadius + margin, [&](uint32_t index) {
+		Vec3f away = bounds.displacement(predators[index].currentPosition, this->currentPosition);
+		float distance2 = dot(away, away);
+		if (distance2 < fearRadius2 && distance2 > 0.f) {
+			// Unit vector away from the predator, weighted from 1 next to it down to 0 at the fear radius
+			float distance = std::sqrt(distance2);
+			direction += away * ((fearRadius - distance) / (fearRadius * distance));
+		}
+	});
+
+	float length2 = dot(direction, direction);
+	if (length2 > 1.f)
+		direction /= std::sqrt(length2);
+	return direction * strength;
+}
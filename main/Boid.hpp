@@ -1,58 +1,56 @@
 #pragma once
 
+#include <utility>
 #include <vector>
 
 #include "Obstacle.hpp"
+#include "Arena.hpp"
+#include "SimulationBounds.hpp"
+#include "SpatialGrid.hpp"
 
 #include "../math/mat44.hpp"
 #include "../math/vec3.hpp"
 #include "../math/other.hpp"
 
-constexpr float EDGE_LIMIT = 2.f;
-
-constexpr float X_MIN = -100.f + EDGE_LIMIT;
-constexpr float X_MAX = 100.f - EDGE_LIMIT;
-constexpr float X_RANGE = X_MAX - X_MIN;
-
-constexpr float Y_MIN = 0.f + EDGE_LIMIT;
-constexpr float Y_MAX = 50.f - EDGE_LIMIT;
-constexpr float Y_RANGE = Y_MAX - Y_MIN;
-
-constexpr float Z_MIN = -100.f + EDGE_LIMIT;
-constexpr float Z_MAX = 100.f - EDGE_LIMIT;
-constexpr float Z_RANGE = Z_MAX - Z_MIN;
-
+/**
+* @brief What the rules see of a neighbour: a single boid, or a block of grid cells far enough
+* away to be summarised by its centre of mass and the sum of the directions of its boids.
+*/
+struct NeighbourSample {
+	Vec3f offset;		// from the boid to the neighbour, or to the centre of mass of the block
+	Vec3f direction;	// sum of the directions of the boids it stands for
+	float weight;		// number of boids it stands for
+};
 
 /**
  * @brief Abstract representation of a boid in the simulation space.
- * Needs a model to be rendered. Can be updated to move in the simulation space
- * using the model2world matrix.
+ * Needs a model facing +X to be rendered; its model2world matrix is built from
+ * currentPosition and currentDirection with make_model_matrices.
  */
 class Boid
 {
 private:
-	Vec3f initialDirection = { 1.f, 0.f, 0.f };
 	Vec3f targetDirection = {};
 
-	Mat44f rotationMatrix = Identity44f;
-	Mat44f translationMatrix = Identity44f;
-
 	/**
 	* @brief Sets the boid's currentPosition to a random one in the simulation space
 	* that doesn't create collisions with obstacles.
 	* 
 	* @param obstacles - The obstacles in the simulation space.
+	* @param bounds - The simulation space.
 	*
 	* @return void
 	*/
-	void randomizePosition(std::vector<Obstacle*> &obstacles) {
-		// spawn boid at random position within simulation space (x, y, z) = (-100, 2, -100) to (100, 50, 100)
+	void randomizePosition(std::vector<Obstacle*> &obstacles, SimulationBounds const& bounds) {
+		// spawn boid at random position within the inner simulation space
+		Vec3f low = bounds.innerMin();
+		Vec3f range = bounds.innerMax() - low;
 		bool collision = false;
 		do {
 			collision = false;
-			this->currentPosition = { (float)rand() / RAND_MAX * X_RANGE + X_MIN,
-									(float)rand() / RAND_MAX * Y_RANGE + Y_MIN,
-									(float)rand() / RAND_MAX * Z_RANGE + Z_MIN };
+			this->currentPosition = { (float)rand() / RAND_MAX * range.x + low.x,
+									(float)rand() / RAND_MAX * range.y + low.y,
+									(float)rand() / RAND_MAX * range.z + low.z };
 			for (auto obs : obstacles) {
 				if (obs->isColliding(this->currentPosition)) {
 					collision = true;
@@ -62,6 +60,28 @@ private:
 		} while (collision);
 	}
 
+	/**
+	* @brief Checks if another boid is within the radius and the vision angle of this one.
+	*
+	* @param other - The other boid.
+	* @param bounds - The simulation space.
+	* @param radius - The vision radius.
+	* @param visionAngle - The vision angle.
+	*
+	* @return bool True if other is a neighbour.
+	*/
+	bool isNeighbour(Boid const& other, SimulationBounds const& bounds, float radius, float visionAngle) const {
+		return sees(bounds.displacement(this->currentPosition, other.currentPosition), radius, visionAngle);
+	}
+
+	/**
+	* @brief Checks if a position at the given offset is within the radius and the vision angle of this boid.
+	*/
+	bool sees(Vec3f diff, float radius, float visionAngle) const {
+		float distance = length(diff);
+		return distance > 0 && distance < radius && acos(dot(this->currentDirection, diff)) < visionAngle;
+	}
+
 	/**
 	* @brief Sets the boid's currentDirection to a random direction.
 	*
@@ -74,32 +94,21 @@ private:
 public:
 	Vec3f currentDirection = {};
 	Vec3f currentPosition = {};
-	Mat44f model2world = Identity44f;
+	float tailPhase = 0.f;	// in turns, so that the fish do not all wag their tails together
 
 	/**
 	* @brief Constructor - creates a Boid object at a random position facing a random direction.
 	*
-	* @param obstacles - A reference to a vector of pointers to obstacles, that is used in randomizePosition(obstacles).
+	* @param obstacles - A reference to a vector of pointers to obstacles, that is used in randomizePosition(obstacles, bounds).
+	* @param bounds - The simulation space to spawn the boid in.
 	* 
 	*/
-	Boid(std::vector<Obstacle*> &obstacles) {
+	Boid(std::vector<Obstacle*> &obstacles, SimulationBounds const& bounds) {
 		// Spawn boid at random position and direction
-		randomizePosition(obstacles);
+		randomizePosition(obstacles, bounds);
 		randomizeDirection();
 		this->targetDirection = currentDirection;
-		// Initial rotation for object
-		float rotationAngle = acos(dot(this->initialDirection, this->currentDirection));
-		Vec3f rotationAxis = normalize(cross(this->initialDirection, this->currentDirection));
-		if (rotationAngle <= radians(90)) {
-			this->rotationMatrix = make_rotation_custom_axis(rotationAxis, rotationAngle);
-		}
-		// If the angle is greater than 90 deg, we need to reverse the rotation to avoid the fish swimming upside down due to the normal rotation.
-		else {
-			this->rotationMatrix = make_rotation_custom_axis(rotationAxis, -(radians(180) - rotationAngle)) * make_rotation_y(radians(180));
-		}
-		// Initial translation for object
-		this->translationMatrix = make_translation(currentPosition);
-		this->model2world = this->translationMatrix * this->rotationMatrix;
+		this->tailPhase = (float)rand() / RAND_MAX;
 	};
 
 	/**
@@ -113,6 +122,10 @@ public:
 		targetDirection = direction;
 	}
 
+	Vec3f getTargetDirection() const {
+		return targetDirection;
+	}
+
 	/**
 	* @brief Updates the boid's currentDirection to be closer to the targetDirection 
 	* using different types of linear interpolation and updates the boid's currentPosition
@@ -120,31 +133,92 @@ public:
 	*
 	* @param speed - The speed of the boid's movement.
 	* @param transition - The weight of the interpolation.
+	* @param bounds - The simulation space, used to wrap the position in periodic mode.
 	*
 	* @return void
 	*/
-	void updateDirection(float, float);
+	void updateDirection(float, float, SimulationBounds const&);
 
 	/**
 	* @brief Finds all the boids within a given radius.
 	*
-	* @param totalBoids - A vector of pointers to all the boids in the simulation.
+	* @param grid - The spatial grid built over totalBoids.
+	* @param totalBoids - A vector of all the boids in the simulation.
+	* @param bounds - The simulation space, distances are measured across its faces in periodic mode.
 	* @param radius - The radius in which to search for neighbours.
 	* @param visionAngle - The angle from the boid's current direction in which to search for neighbours.
+	* @param margin - How far the boids may have moved since the grid was built.
+	* @param neighbours - The caller's list, the pointers to the neighbouring boids are appended to it.
 	*
-	* @return std::vector<Boid*> A vector of pointers to the neighbouring boids.
+	* @return void
+	*/
+	void findNeighbours(SpatialGrid const&, std::vector<Boid>&, SimulationBounds const&, float, float, float, ArenaVector<Boid*>&);
+
+	/**
+	* @brief Finds the boids within a given radius among a list of candidates, e.g. a Verlet list.
+	*
+	* @param candidates - Pointer to the indices of the candidates in totalBoids.
+	* @param count - The number of candidates.
+	* @param totalBoids - A vector of all the boids in the simulation.
+	* @param bounds - The simulation space, distances are measured across its faces in periodic mode.
+	* @param radius - The radius in which to search for neighbours.
+	* @param visionAngle - The angle from the boid's current direction in which to search for neighbours.
+	* @param neighbours - The caller's list, the pointers to the neighbouring boids are appended to it.
+	*
+	* @return void
 	*/
-	std::vector<Boid*> findNeighbours(std::vector<Boid*>, float, float);
+	void filterNeighbours(uint32_t const*, std::size_t, std::vector<Boid>&, SimulationBounds const&, float, float, ArenaVector<Boid*>&);
+
+	/**
+	* @brief Finds the k nearest boids within a given radius and the vision angle (topological neighbours).
+	* The grid is searched ring by ring around the boid with a bounded heap of the k nearest so far, and the
+	* search stops as soon as the next ring is farther than the k-th of them, so dense clusters do not grow the lists.
+	*
+	* @param grid - The spatial grid built over totalBoids.
+	* @param totalBoids - A vector of all the boids in the simulation.
+	* @param bounds - The simulation space, distances are measured across its faces in periodic mode.
+	* @param radius - The radius in which to search for neighbours.
+	* @param visionAngle - The angle from the boid's current direction in which to search for neighbours.
+	* @param margin - How far the boids may have moved since the grid was built.
+	* @param k - The maximum number of neighbours.
+	* @param nearest - The caller's scratch heap of (squared distance, index), cleared before use.
+	* @param neighbours - The caller's list, the pointers to at most k neighbouring boids are appended to it.
+	*
+	* @return void
+	*/
+	void findNearestNeighbours(SpatialGrid const&, std::vector<Boid>&, SimulationBounds const&, float, float, float, std::size_t,
+		ArenaVector<std::pair<float, uint32_t>>&, ArenaVector<Boid*>&);
+
+	/**
+	* @brief Approximate neighbour search: the boids in the cells near this one, and the aggregates
+	* of the blocks of cells seen under an angle below openingAngle (see SpatialGrid::forEachSample).
+	*
+	* @param grid - The spatial grid built over totalBoids, with its aggregates.
+	* @param totalBoids - A vector of all the boids in the simulation.
+	* @param bounds - The simulation space, distances are measured across its faces in periodic mode.
+	* @param radius - The radius in which to search for neighbours.
+	* @param visionAngle - The angle from the boid's current direction in which to search for neighbours.
+	* @param margin - How far the boids may have moved since the grid was built.
+	* @param openingAngle - The opening angle of the blocks, 0 for the exact neighbours.
+	* @param samples - The caller's list, the neighbours and the aggregates are appended to it.
+	*
+	* @return void
+	*/
+	void sampleNeighbours(SpatialGrid const&, std::vector<Boid>&, SimulationBounds const&, float, float, float, float, ArenaVector<NeighbourSample>&);
 
 	/**
 	* @brief Creates a direction vector towards the centre of mass of the neighbouring boids.
 	*
 	* @param neighbours - A vector of pointers to the neighbouring boids.
 	* @param strength - The strength of the cohesion rule.
+	* @param bounds - The simulation space, distances are measured across its faces in periodic mode.
 	*
 	* @return Vec3f The direction vector created by the cohesion rule.
 	*/
-	Vec3f applyCohesion(std::vector<Boid*>, float);
+	Vec3f applyCohesion(ArenaVector<Boid*> const&, float, SimulationBounds const&);
+
+	// Same rule on the samples of sampleNeighbours(), every sample weighted by the boids it stands for
+	Vec3f applyCohesion(ArenaVector<NeighbourSample> const&, float);
 
 	/**
 	* @brief Creates a direction vector towards the average direction of the neighbouring boids.
@@ -154,26 +228,36 @@ public:
 	*
 	* @return Vec3f The direction vector created by the alignment rule.
 	*/
-	Vec3f applyAlignment(std::vector<Boid*>, float);
+	Vec3f applyAlignment(ArenaVector<Boid*> const&, float);
+
+	// Same rule on neighbour samples
+	Vec3f applyAlignment(ArenaVector<NeighbourSample> const&, float);
 
 	/**
 	* @brief Creates a direction vector away from the neighbouring boids.
 	*
 	* @param neighbours - A vector of pointers to the neighbouring boids.
 	* @param strength - The strength of	the separation rule.
+	* @param radius - The vision radius; boids closer than half of it are avoided.
+	* @param bounds - The simulation space, distances are measured across its faces in periodic mode.
 	*
 	* @return Vec3f The direction vector created by the separation rule.
 	*/
-	Vec3f applySeparation(std::vector<Boid*>, float, float);
+	Vec3f applySeparation(ArenaVector<Boid*> const&, float, float, SimulationBounds const&);
+
+	// Same rule on neighbour samples
+	Vec3f applySeparation(ArenaVector<NeighbourSample> const&, float, float);
 
 	/**
 	* @brief Creates a direction vector away from the edges of the simulation space.
+	* There are no edges to avoid in periodic mode.
 	*
+	* @param bounds - The simulation space.
 	* @param strength - The strength of the rule.
 	*
 	* @return Vec3f The direction vector created by the rule.
 	*/
-	Vec3f avoidEdges(float);
+	Vec3f avoidEdges(SimulationBounds const&, float);
 
 	/**
 	* @brief Checks for collisions with the obstacles in the simulation space
@@ -184,5 +268,20 @@ public:
 	*
 	* @return Vec3f The direction vector created by the rule.
 	*/
-	Vec3f avoidObstacles(std::vector<Obstacle*>, float);
+	Vec3f avoidObstacles(std::vector<Obstacle*> const&, float);
+
+	/**
+	* @brief Creates a direction vector away from the predators within the fear radius, all around
+	* the boid. Closer predators push harder; the result is at most as long as the strength.
+	*
+	* @param grid - The spatial grid built over the predators.
+	* @param predators - The predators, indexed like the grid.
+	* @param bounds - The simulation space.
+	* @param fearRadius - The distance at which the boid senses a predator.
+	* @param strength - The strength of the rule.
+	* @param margin - How far the predators may have moved since the grid was built.
+	*
+	* @return Vec3f The direction vector created by the rule.
+	*/
+	Vec3f fleePredators(SpatialGrid const&, std::vector<Boid> const&, SimulationBounds const&, float, float, float);
 };
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "BoidPool.hpp"
+
+BoidHandle BoidPool::create(std::vector<Obstacle*>& obstacles, SimulationBounds const& bounds)
+{
+    // Reuse a free slot if there is one
+    uint32_t slot;
+    if (!this->freeSlots.empty()) {
+        slot = this->freeSlots.back();
+        this->freeSlots.pop_back();
+    }
+    else {
+        slot = (uint32_t)this->slots.size();
+        this->slots.push_back(Slot{ 0, 0 });
+    }
+
+    this->slots[slot].dense = (uint32_t)this->boids.size();
+    this->boids.emplace_back(obstacles, bounds);
+    this->denseToSlot.push_back(slot);
+    this->revision++;
+    return BoidHandle{ slot, this->slots[slot].generation, this->species };
+}
+
+void BoidPool::remove(BoidHandle handle)
+{
+    if (get(handle) == nullptr)
+        return;
+
+    // Move the last boid into the hole and pop the back
+    uint32_t dense = this->slots[handle.slot].dense;
+    uint32_t last = (uint32_t)this->boids.size() - 1;
+    if (dense != last) {
+        this->boids[dense] = this->boids[last];
+        this->denseToSlot[dense] = this->denseToSlot[last];
+        this->slots[this->denseToSlot[dense]].dense = dense;
+    }
+    this->boids.pop_back();
+    this->denseToSlot.pop_back();
+
+    // Invalidate the handles to this slot before it is reused
+    this->slots[handle.slot].generation++;
+    this->freeSlots.push_back(handle.slot);
+    this->revision++;
+}
+
+void BoidPool::reorder(std::vector<uint32_t> const& order)
+{
+    this->boidsScratch.clear();
+    this->denseScratch.clear();
+    for (uint32_t from : order) {
+        this->boidsScratch.push_back(this->boids[from]);
+        this->denseScratch.push_back(this->denseToSlot[from]);
+    }
+    this->boids.swap(this->boidsScratch);
+    this->denseToSlot.swap(this->denseScratch);
+
+    // Point the slots at the new positions, so the handles follow their boids
+    for (uint32_t dense = 0; dense < (uint32_t)this->denseToSlot.size(); dense++)
+        this->slots[this->denseToSlot[dense]].dense = dense;
+    this->revision++;
+}
+
+Boid* BoidPool::get(BoidHandle handle)
+{
+    if (handle.species != this->species || handle.slot >= this->slots.size() || this->slots[handle.slot].generation != handle.generation)
+        return nullptr;
+    return &this->boids[this->slots[handle.slot].dense];
+}
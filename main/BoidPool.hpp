@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Boid.hpp"
+
+/**
+* @brief Stable reference to a boid in a BoidPool. Stays valid while the boid is alive
+* and is detected as stale once the boid is removed, even if its slot is reused.
+*/
+struct BoidHandle {
+	uint32_t slot = UINT32_MAX;
+	uint32_t generation = 0;
+	uint32_t species = 0;
+};
+
+/**
+* @brief Slot map owning the boids of the simulation.
+* The boids are stored densely by value; removing one moves the last boid into its
+* place, so creation and removal are O(1) and the storage never has holes. The memory
+* of removed boids and slots is reused, so resizing the flock does not allocate
+* once the pool has reached its largest size.
+*/
+class BoidPool {
+private:
+	// Slot of a handle: where its boid currently is in the dense storage
+	struct Slot {
+		uint32_t dense;
+		uint32_t generation;
+	};
+
+	std::vector<Boid> boids;
+	std::vector<uint32_t> denseToSlot;
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeSlots;
+	uint32_t revision = 0;
+	uint32_t species = 0;	// stamped into the handles, which are only valid in the pool of their species
+
+	// Reused by reorder()
+	std::vector<Boid> boidsScratch;
+	std::vector<uint32_t> denseScratch;
+
+public:
+	/**
+	* @brief Constructor - creates an empty pool for the boids of a species.
+	*
+	* @param species - The species id of the boids in the pool.
+	*/
+	BoidPool(uint32_t species = 0) {
+		this->species = species;
+	}
+
+	uint32_t getSpecies() const {
+		return this->species;
+	}
+
+	/**
+	* @brief Spawns a new boid at a random position that does not collide with the obstacles.
+	*
+	* @param obstacles - The obstacles in the simulation space.
+	* @param bounds - The simulation space to spawn the boid in.
+	*
+	* @return BoidHandle The handle of the new boid.
+	*/
+	BoidHandle create(std::vector<Obstacle*>&, SimulationBounds const&);
+
+	/**
+	* @brief Removes a boid. Stale handles are ignored.
+	*
+	* @param handle - The handle of the boid to remove.
+	*
+	* @return void
+	*/
+	void remove(BoidHandle);
+
+	/**
+	* @brief Permutes the dense storage. Handles stay valid, pointers and indices do not.
+	*
+	* @param order - For every new position, the current position of the boid that goes there.
+	*
+	* @return void
+	*/
+	void reorder(std::vector<uint32_t> const&);
+
+	/**
+	* @brief Resolves a handle.
+	*
+	* @param handle - The handle of the boid.
+	*
+	* @return Boid* Pointer to the boid, or nullptr if the handle is stale.
+	*/
+	Boid* get(BoidHandle);
+
+	/**
+	* @brief Returns the handle of the boid at a position of the dense storage.
+	*
+	* @param index - The position of the boid, smaller than size().
+	*
+	* @return BoidHandle The handle of the boid.
+	*/
+	BoidHandle handleAt(std::size_t index) const {
+		uint32_t slot = this->denseToSlot[index];
+		return BoidHandle{ slot, this->slots[slot].generation, this->species };
+	}
+
+	/**
+	* @brief Dense storage of all the boids alive. Pointers into it are valid
+	* until the next create() or remove().
+	*/
+	std::vector<Boid>& all() {
+		return this->boids;
+	}
+
+	std::size_t size() const {
+		return this->boids.size();
+	}
+
+	/**
+	* @brief Counter bumped whenever boids are created, removed or moved in the dense storage,
+	* so that data indexed by dense position can tell when it is out of date.
+	*/
+	uint32_t getRevision() const {
+		return this->revision;
+	}
+
+	Boid& operator[](std::size_t index) {
+		return this->boids[index];
+	}
+
+	std::vector<Boid>::iterator begin() {
+		return this->boids.begin();
+	}
+
+	std::vector<Boid>::iterator end() {
+		return this->boids.end();
+	}
+};
@@ -26,15 +26,9 @@ Model generate_cone(std::size_t subdivs, Material material, Mat44f transformMatr
 		prevY = y;
 		prevZ = z;
 	}
-	for (auto& v : vertices) {
-		Vec4f p4{ v.positions.x, v.positions.y, v.positions.z, 1.f };
-		Vec4f t = transformMatrix * p4;
-		t /= t.w;
-
-		v.positions = Vec3f{ t.x, t.y, t.z };
-
-		v.normals = N * v.normals;
-	}
+	// The transforms are affine, so the points need no perspective divide
+	transform_points(transformMatrix, &vertices.data()->positions, vertices.size(), sizeof(Vertex));
+	transform_vectors(N, &vertices.data()->normals, vertices.size(), sizeof(Vertex));
 
 	return Model(vertices, material);
 }
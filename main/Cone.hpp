@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Model.hpp"
+#include "../math/batch.hpp"
 
 /**
 * @brief Creates a cone mesh made of triangles with vertices, normals and material.
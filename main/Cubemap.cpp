@@ -1,29 +1,44 @@
 #include "Cubemap.hpp"
+#include "GpuProfiler.hpp"
+
+CubemapFace load_cubemap_face(const char* path, TextureCompression compression) {
+    CubemapFace face = load_texture_data(path, true, compression);
+    if (face.levels.empty())
+        printf("Cubemap tex failed to load at path: %s", path);
+    return face;
+}
 
 Cubemap::Cubemap(const char* cubemap[6]) {
+    TextureCompression compression = texture_compression_supported(TextureCompression::BC1) ? TextureCompression::BC1 : TextureCompression::None;
+    CubemapFace faces[6];
+    for (unsigned int i = 0; i < 6; i++)
+        faces[i] = load_cubemap_face(cubemap[i], compression);
+    setup(faces);
+}
+
+Cubemap::Cubemap(CubemapFace faces[6]) {
+    setup(faces);
+}
+
+void Cubemap::setup(CubemapFace faces[6]) {
     unsigned int textureID;
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-    int width, height, nrChannels;
+    // Every face that loaded has the same number of levels, the cache files being made the same way
+    GLint levels = 0;
+    for (unsigned int i = 0; i < 6 && levels == 0; i++)
+        levels = (GLint)faces[i].levels.size();
     for (unsigned int i = 0; i < 6; i++)
     {
-        unsigned char* data = stbi_load(cubemap[i], &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            //stbi_set_flip_vertically_on_load(false);
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-            );
-            stbi_image_free(data);
-        }
-        else
+        if (!faces[i].levels.empty())
         {
-            printf("Cubemap tex failed to load at path: %s", cubemap[i]);
-            stbi_image_free(data);
+            upload_texture_data(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, faces[i]);
+            faces[i] = CubemapFace{};
         }
     }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels > 0 ? levels - 1 : 0);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -52,22 +67,26 @@ Cubemap::Cubemap(const char* cubemap[6]) {
 }
 
 void Cubemap::render(Mat44f projection, Mat44f world2camera, unsigned int shaderProgram) {
-    glUseProgram(shaderProgram);
-    glDepthFunc(GL_LEQUAL);
-    glUniformMatrix4fv(
+    gl_state_change(glUseProgram, shaderProgram);
+    gl_state_change(glDepthFunc, GL_LEQUAL);
+    gl_uniform(glUniformMatrix4fv,
         0,
         1, GL_TRUE, projection.v
     );
     Mat44f view = mat44(mat33(world2camera));
-    glUniformMatrix4fv(
+    gl_uniform(glUniformMatrix4fv,
         1,
         1, GL_TRUE, view.v
     );
-    glBindVertexArray(this->VAO);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, this->textureID);
+    gl_state_change(glBindVertexArray, this->VAO);
+    gl_state_change(glActiveTexture, GL_TEXTURE0);
+    gl_state_change(glBindTexture, GL_TEXTURE_CUBE_MAP, this->textureID);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-    glDepthFunc(GL_LESS);
-    glUseProgram(0);
+
+    RenderStats& stats = GpuProfiler::get().stats;
+    stats.drawCalls++;
+    stats.vertices += 36;
+    gl_state_change(glBindVertexArray, 0);
+    gl_state_change(glDepthFunc, GL_LESS);
+    gl_state_change(glUseProgram, 0);
 }
@@ -3,7 +3,7 @@
 #include <glad.h>
 #include "Shader.hpp"
 #include "../math/mat33.hpp"
-#include "../third_party/stb/include/stb_image.h"
+#include "TextureCache.hpp"
 
 constexpr float cubePositions[] = {
         -1.0f,  1.0f, -1.0f,
@@ -49,6 +49,22 @@ constexpr float cubePositions[] = {
          1.0f, -1.0f,  1.0f
 };
 
+/**
+* @brief The mip levels of one face of a cubemap, loaded off the GL thread and freed when the face is uploaded.
+*/
+using CubemapFace = TextureData;
+
+/**
+* @brief Loads one face of a cubemap with its mip levels, from the texture cache when it is up to date.
+* Does not touch GL, so it can run on any thread.
+*
+* @param path - The path to the texture file of the face.
+* @param compression - The block compression of the face, see texture_compression_supported.
+*
+* @return The loaded face, without levels if it failed to load.
+*/
+CubemapFace load_cubemap_face(const char*, TextureCompression = TextureCompression::None);
+
 /**
 * @brief Representation of a cubemap used for skyboxes.
 */
@@ -56,15 +72,32 @@ class Cubemap {
 private:
 	unsigned int textureID = 0;
 	unsigned int VBO = 0, VAO = 0;
+
+	/**
+	* @brief Uploads and frees the faces and sets up the rendering data.
+	*
+	* @param faces - The 6 decoded faces.
+	*
+	* @return void
+	*/
+	void setup(CubemapFace faces[6]);
 public:
 	/**
-	* @brief Creates a cube map object by loading the texture data
-	* and setting up rendering data.
+	* @brief Creates a cube map object by loading the texture data, block compressed
+	* if supported, and setting up rendering data.
 	*
 	* @param cubemap - An array of 6 strings containing the paths to the
 	* texture files for the cube map.
 	*/
 	Cubemap(const char* cubemap[6]);
+
+	/**
+	* @brief Creates a cube map object from faces already decoded with load_cubemap_face,
+	* uploading and freeing their pixels, and sets up the rendering data.
+	*
+	* @param faces - The 6 decoded faces, in the order +X, -X, +Y, -Y, +Z, -Z.
+	*/
+	Cubemap(CubemapFace faces[6]);
 	~Cubemap() {};
 	
 	/**
@@ -0,0 +1,105 @@
+#include "Flock.hpp"
+
+#include <algorithm>
+
+#include "Arena.hpp"
+#include "Profiler.hpp"
+#include "Rules.hpp"
+
+void Flock::resize(uint32_t species, std::size_t count, std::vector<Obstacle*>& obstacles)
+{
+    BoidPool& boids = this->species[species].boids;
+    while (count > boids.size()) {
+        boids.create(obstacles, this->bounds);
+    }
+
+    // If the number of boids is decreased, delete the last boids
+    while (count < boids.size()) {
+        boids.remove(boids.handleAt(boids.size() - 1));
+    }
+}
+
+void Flock::sortByPosition(uint32_t species)
+{
+    PROFILE_SCOPE(ProfileStage::Reorder);
+    Species& s = this->species[species];
+    if (s.boids.size() > 0)
+        s.boids.reorder(s.mortonOrder.sort(s.boids.all(), this->bounds));
+    s.ticksSinceSort = 0;
+}
+
+void Flock::buildGrids(FlockSettings const& settings, float dt)
+{
+    PROFILE_SCOPE(ProfileStage::NeighbourSearch);
+    for (uint32_t searched = 0; searched < MAX_SPECIES; searched++) {
+        std::vector<Boid>& boids = this->species[searched].boids.all();
+        if (boids.empty())
+            continue;
+
+        float cellSize = 0.f;
+        bool needed = false;
+        for (uint32_t observer = 0; observer < MAX_SPECIES; observer++) {
+            Species const& s = this->species[observer];
+            SpeciesSettings const& params = settings.species[observer];
+            if (s.boids.size() == 0 || (s.rules & AllRules::neighbourRules) == 0 || settings.interaction[observer][searched] == 0.f)
+                continue;
+            // A species finds its own kind in its Verlet lists, unless the skin is too thin for this tick
+            if (observer == searched && settings.verletLists && !settings.approximate && !settings.topological && dt * params.speed <= settings.verletSkin)
+                continue;
+            cellSize = std::max(cellSize, params.visionRange);
+            needed = true;
+        }
+        // Predators are searched by every species fleeing them, with its fear radius
+        if (settings.species[searched].predator) {
+            for (uint32_t prey = 0; prey < MAX_SPECIES; prey++) {
+                if (this->species[prey].boids.size() > 0 && (this->species[prey].rules & RULE_FLEE) != 0) {
+                    cellSize = std::max(cellSize, settings.species[prey].fearRadius);
+                    needed = true;
+                }
+            }
+        }
+        if (!needed)
+            continue;
+        SpatialGrid& grid = this->species[searched].grid;
+        if (settings.approximate) {
+            // Cells of half the vision range, so that the blocks of cells near the edge of the
+            // vision sphere can already be summarised
+            grid.build(this->bounds, cellSize / 2.f, &boids.data()->currentPosition, boids.size(), sizeof(Boid));
+            grid.buildAggregates(&boids.data()->currentPosition, &boids.data()->currentDirection, sizeof(Boid));
+        }
+        else if (settings.topological) {
+            grid.build(this->bounds, cellSize / 2.f, &boids.data()->currentPosition, boids.size(), sizeof(Boid));
+        }
+        else {
+            grid.build(this->bounds, cellSize, &boids.data()->currentPosition, boids.size(), sizeof(Boid));
+        }
+    }
+}
+
+void Flock::update(float dt, FlockSettings const& settings, std::vector<Obstacle*> const& obstacles)
+{
+    // Neighbour lists and other per-tick data live in the arenas until the next tick
+    Arena::beginTick();
+
+    if (size() == 0)
+        return;
+
+    if (settings.sortInterval > 0) {
+        for (uint32_t s = 0; s < MAX_SPECIES; s++) {
+            if (this->species[s].boids.size() > 0 && ++this->species[s].ticksSinceSort >= settings.sortInterval)
+                sortByPosition(s);
+        }
+    }
+
+    for (uint32_t s = 0; s < MAX_SPECIES; s++)
+        this->species[s].rules = activeRules(settings.species[s], settings, this->bounds);
+    buildGrids(settings, dt);
+
+    // Run the tick specialised for the rules that have an effect with the settings of each species
+    for (uint32_t s = 0; s < MAX_SPECIES; s++) {
+        if (this->species[s].boids.size() == 0)
+            continue;
+        RuleContext context{ settings, settings.species[s], this->bounds, obstacles, *this, dt, {}, {}, {} };
+        RULE_PIPELINES[this->species[s].rules](*this, s, context, dt);
+    }
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Boid.hpp"
+#include "BoidPool.hpp"
+#include "Obstacle.hpp"
+#include "SimulationBounds.hpp"
+#include "SpatialGrid.hpp"
+#include "MortonOrder.hpp"
+#include "VerletList.hpp"
+
+// Number of species a flock can hold
+constexpr uint32_t MAX_SPECIES = 4;
+
+/**
+* @brief Parameters of the rules of one species, set from the GUI.
+*/
+struct SpeciesSettings {
+	float speed = 40.f;
+	float visionRange = 12.f;
+	float visionAngle = 150.f;
+
+	float cohesion = 1.f;
+	float alignment = 1.f;
+	float separation = 3.f;
+	float edgeAvoidance = 2.f;
+	float obstacleAvoidance = 3.f;
+
+	// Predators are fled from by the boids of every other species that sense them within their fear radius
+	bool predator = false;
+	float fearRadius = 30.f;
+	float flee = 4.f;
+};
+
+/**
+* @brief Parameters of a simulation tick, set from the GUI.
+*/
+struct FlockSettings {
+	// Parameters of every species
+	SpeciesSettings species[MAX_SPECIES];
+
+	// interaction[a][b] weighs the cohesion, alignment and separation of species a towards
+	// its neighbours of species b: 0 ignores them, negative values turn attraction into repulsion
+	float interaction[MAX_SPECIES][MAX_SPECIES] = {
+		{ 1.f, 0.f, 0.f, 0.f },
+		{ 0.f, 1.f, 0.f, 0.f },
+		{ 0.f, 0.f, 1.f, 0.f },
+		{ 0.f, 0.f, 0.f, 1.f },
+	};
+
+	// User guidance: a fixed direction, or a point every boid heads to
+	Vec3f targetDirection = { 0.f, 0.f, 0.f };
+	bool followTargetPoint = false;
+	Vec3f targetPoint = { 0.f, 0.f, 0.f };
+
+	// Neighbour search: cached candidate lists with a skin instead of a grid search every tick
+	bool verletLists = false;
+	float verletSkin = 2.f;
+
+	// Ticks between two sorts of the boids by Morton code of their position, 0 to never sort
+	int sortInterval = 0;
+
+	// Topological neighbours: every boid interacts with its k nearest visible boids of each
+	// species (within the vision range) instead of all the boids within the vision range
+	bool topological = false;
+	int topologicalNeighbours = 7;
+
+	// Experimental level-of-detail neighbour search: blocks of cells seen under an angle below
+	// openingAngle (edge / distance) act on the rules through their aggregates only. Not a performance
+	// mode: slower than the exact search unless the flock is very dense and the errors large (see --benchmark)
+	bool approximate = false;
+	float openingAngle = 1.f;
+};
+
+/**
+* @brief The boids of the simulation, the volume they live in and the spatial
+* indices used to find their neighbours. Every species has its own dense pool and its
+* own grid, so the neighbours of one species are found without visiting the others.
+*/
+class Flock {
+private:
+	// The boids of one species and their spatial index
+	struct Species {
+		BoidPool boids;
+		SpatialGrid grid;		// searched by the species that interact with this one
+		VerletList verlet;		// neighbours within the species
+		MortonOrder mortonOrder;
+		int ticksSinceSort = 0;
+		uint32_t rules = 0;
+	};
+
+	SimulationBounds bounds;
+	Species species[MAX_SPECIES];
+
+	template<class... Rules>
+	friend struct RulePipeline;
+
+	/**
+	* @brief Builds the grid of every species searched by another one this tick (or by itself
+	* without Verlet lists), with the largest vision range or fear radius of the species that search it.
+	* In approximate mode the cells are half as large and topped with their aggregate pyramid, in
+	* topological mode they are half as large to search them ring by ring.
+	*/
+	void buildGrids(FlockSettings const&, float);
+
+public:
+	/**
+	* @brief Constructor - creates an empty flock living in the given bounds.
+	*
+	* @param bounds - The simulation space.
+	*/
+	Flock(SimulationBounds bounds) {
+		this->bounds = bounds;
+		for (uint32_t s = 0; s < MAX_SPECIES; s++)
+			this->species[s].boids = BoidPool(s);
+	}
+
+	/**
+	* @brief Changes the simulation space. Boids outside the new bounds are steered back by the edge rule,
+	* or wrapped back in on their next move with periodic bounds.
+	*
+	* @param bounds - The new simulation space.
+	*
+	* @return void
+	*/
+	void setBounds(SimulationBounds bounds) {
+		this->bounds = bounds;
+	}
+
+	SimulationBounds const& getBounds() const {
+		return this->bounds;
+	}
+
+	/**
+	* @brief Spawns or removes boids of a species until it has the given size.
+	*
+	* @param species - The species id, smaller than MAX_SPECIES.
+	* @param count - The number of boids of the species.
+	* @param obstacles - The obstacles new boids must not spawn in.
+	*
+	* @return void
+	*/
+	void resize(uint32_t, std::size_t, std::vector<Obstacle*>&);
+
+	/**
+	* @brief Sorts the boids of a species by Morton code of their position, so that boids
+	* close in space are close in memory. Handles to the boids stay valid.
+	*
+	* @param species - The species to sort.
+	*
+	* @return void
+	*/
+	void sortByPosition(uint32_t);
+
+	/**
+	* @brief Advances the simulation by one tick. Every species runs the rule pipeline specialised
+	* for the rules that have an effect with its settings (see Rules.hpp).
+	* Every settings.sortInterval ticks, the boids are sorted by position first.
+	*
+	* @param dt - The time since the last tick, in seconds.
+	* @param settings - The parameters of the rules.
+	* @param obstacles - The obstacles the boids avoid.
+	*
+	* @return void
+	*/
+	void update(float, FlockSettings const&, std::vector<Obstacle*> const&);
+
+	/**
+	* @brief Resolves a handle of a boid of any species.
+	*
+	* @param handle - The handle of the boid.
+	*
+	* @return Boid* Pointer to the boid, or nullptr if the handle is stale.
+	*/
+	Boid* get(BoidHandle handle) {
+		if (handle.species >= MAX_SPECIES)
+			return nullptr;
+		return this->species[handle.species].boids.get(handle);
+	}
+
+	/**
+	* @brief Returns the handle of a boid, counting the boids of all the species in order.
+	*
+	* @param index - The position of the boid, smaller than size().
+	*
+	* @return BoidHandle The handle of the boid.
+	*/
+	BoidHandle handleAt(std::size_t index) const {
+		uint32_t s = 0;
+		while (index >= this->species[s].boids.size()) {
+			index -= this->species[s].boids.size();
+			s++;
+		}
+		return this->species[s].boids.handleAt(index);
+	}
+
+	BoidPool& pool(uint32_t species) {
+		return this->species[species].boids;
+	}
+
+	/**
+	* @brief The number of boids of all the species.
+	*/
+	std::size_t size() const {
+		std::size_t total = 0;
+		for (Species const& s : this->species)
+			total += s.boids.size();
+		return total;
+	}
+
+	/**
+	* @brief The RuleBit mask of the rules run by the last tick of a species.
+	*/
+	uint32_t activeRuleMask(uint32_t species) const {
+		return this->species[species].rules;
+	}
+
+	/**
+	* @brief The spatial grid of a species, valid during a tick if another species searches it.
+	*/
+	SpatialGrid const& grid(uint32_t species) const {
+		return this->species[species].grid;
+	}
+
+	VerletList& verletList(uint32_t species) {
+		return this->species[species].verlet;
+	}
+};
@@ -0,0 +1,216 @@
+#include "FrameRecorder.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include "../third_party/stb/include/stb_image_write.h"
+
+namespace {
+    // How long collect(true) waits on a fence before checking it again, in nanoseconds
+    constexpr GLuint64 FENCE_TIMEOUT = 100000000;
+}
+
+FrameRecorder::FrameRecorder(int width, int height, std::string directory, Format format)
+    : width(width), height(height), directory(std::move(directory)), format(format)
+{
+    // sRGB color like the window's, so that GL_FRAMEBUFFER_SRGB gives the same image
+    glGenRenderbuffers(1, &this->colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, this->colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, width, height);
+    glGenRenderbuffers(1, &this->depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, this->depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &this->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depthBuffer);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("FrameRecorder: incomplete framebuffer (0x%x)\n", status);
+        glDeleteFramebuffers(1, &this->framebuffer);
+        this->framebuffer = 0;
+        return;
+    }
+
+    this->writer = std::thread(&FrameRecorder::writeLoop, this);
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    if (this->writer.joinable()) {
+        finish();
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+        this->changed.notify_all();
+        this->writer.join();
+    }
+
+    for (GLuint buffer : this->freeBuffers)
+        glDeleteBuffers(1, &buffer);
+    glDeleteFramebuffers(1, &this->framebuffer);
+    glDeleteRenderbuffers(1, &this->colorBuffer);
+    glDeleteRenderbuffers(1, &this->depthBuffer);
+}
+
+void FrameRecorder::bind()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+}
+
+void FrameRecorder::capture()
+{
+    std::size_t size = (std::size_t)this->width * this->height * 3;
+
+    // A new pixel buffer when every one is still being read into, rather than waiting for one
+    GLuint buffer;
+    if (!this->freeBuffers.empty()) {
+        buffer = this->freeBuffers.back();
+        this->freeBuffers.pop_back();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+    }
+    else {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    }
+
+    // Into the bound pixel buffer: returns without waiting for the frame to be rendered
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, this->framebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, this->width, this->height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    this->pending.push_back(Readback{ buffer, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), this->captured++ });
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // Nothing is presented offscreen, flush so that the GPU gets to the fence
+    glFlush();
+
+    collect(false);
+}
+
+void FrameRecorder::collect(bool wait)
+{
+    std::size_t rowSize = (std::size_t)this->width * 3;
+    std::size_t size = rowSize * this->height;
+
+    while (!this->pending.empty()) {
+        Readback readback = this->pending.front();
+        GLenum result = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? FENCE_TIMEOUT : 0);
+        if (result == GL_TIMEOUT_EXPIRED) {
+            if (!wait)
+                break;
+            continue;
+        }
+        this->pending.pop_front();
+        glDeleteSync(readback.fence);
+
+        // The pixels cannot be trusted: the frame is dropped, not written
+        if (result == GL_WAIT_FAILED) {
+            printf("FrameRecorder: waiting for the readback of frame %zu failed, frame dropped\n", readback.index);
+            this->freeBuffers.push_back(readback.buffer);
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->failed++;
+            }
+            this->changed.notify_all();
+            continue;
+        }
+
+        // Pixels for the copy, waiting only if the writer is too far behind
+        Frame frame{ readback.index, {} };
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->changed.wait(lock, [this]() { return this->queue.size() < MAX_QUEUED_FRAMES; });
+            if (!this->spare.empty()) {
+                frame.pixels.swap(this->spare.back());
+                this->spare.pop_back();
+            }
+        }
+        frame.pixels.resize(size);
+
+        // GL rows start at the bottom, image files at the top
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        unsigned char const* mapped = (unsigned char const*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (mapped) {
+            for (int row = 0; row < this->height; row++)
+                std::memcpy(&frame.pixels[row * rowSize], mapped + (this->height - 1 - row) * rowSize, rowSize);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        this->freeBuffers.push_back(readback.buffer);
+
+        // No pixels to write: the frame is dropped like a failed wait
+        if (!mapped) {
+            printf("FrameRecorder: cannot map the pixels of frame %zu, frame dropped\n", readback.index);
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->spare.push_back(std::move(frame.pixels));
+                this->failed++;
+            }
+            this->changed.notify_all();
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->queue.push_back(std::move(frame));
+        }
+        this->changed.notify_all();
+    }
+}
+
+void FrameRecorder::writeLoop()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true) {
+        this->changed.wait(lock, [this]() { return !this->queue.empty() || this->stopping; });
+        if (this->queue.empty())
+            return;
+        Frame frame = std::move(this->queue.front());
+        this->queue.pop_front();
+        this->changed.notify_all();
+
+        lock.unlock();
+        bool success = write(frame);
+        lock.lock();
+
+        if (success)
+            this->written++;
+        else
+            this->failed++;
+        this->spare.push_back(std::move(frame.pixels));
+        this->changed.notify_all();
+    }
+}
+
+bool FrameRecorder::write(Frame const& frame) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/frame_%06zu.%s", frame.index, this->format == Format::PNG ? "png" : "rgb");
+    std::string path = this->directory + name;
+
+    bool success = false;
+    if (this->format == Format::PNG) {
+        success = stbi_write_png(path.c_str(), this->width, this->height, 3, frame.pixels.data(), this->width * 3) != 0;
+    }
+    else if (FILE* file = fopen(path.c_str(), "wb")) {
+        success = fwrite(frame.pixels.data(), 1, frame.pixels.size(), file) == frame.pixels.size();
+        success = fclose(file) == 0 && success;
+    }
+    if (!success)
+        printf("FrameRecorder: cannot write %s\n", path.c_str());
+    return success;
+}
+
+std::size_t FrameRecorder::finish()
+{
+    collect(true);
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->changed.wait(lock, [this]() { return this->written + this->failed == this->captured; });
+    return this->written;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <glad.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* @brief Renders into a framebuffer object and saves every frame as an image file, for the offscreen mode.
+* The pixels of a frame are read back into a pixel buffer object (glReadPixels into a GL_PIXEL_PACK_BUFFER
+* returns at once) guarded by a fence, and only copied out once the fence has signalled, a few frames later,
+* so the render loop never waits for the GPU. The copies are encoded and written by a writer thread;
+* the render loop only waits for it when it falls MAX_QUEUED_FRAMES frames behind, to bound the memory.
+*/
+class FrameRecorder {
+public:
+	enum class Format {
+		PNG,	// frame_000000.png
+		Raw		// frame_000000.rgb: width * height * 3 bytes, RGB, top row first
+	};
+
+	// Frames waiting for the writer before capture() waits for it
+	static constexpr std::size_t MAX_QUEUED_FRAMES = 8;
+
+private:
+	// A frame being read back into a pixel buffer
+	struct Readback {
+		GLuint buffer;
+		GLsync fence;
+		std::size_t index;
+	};
+
+	// A frame copied out of its pixel buffer, top row first
+	struct Frame {
+		std::size_t index;
+		std::vector<unsigned char> pixels;
+	};
+
+	int width;
+	int height;
+	std::string directory;
+	Format format;
+
+	GLuint framebuffer = 0;
+	GLuint colorBuffer = 0;
+	GLuint depthBuffer = 0;
+
+	std::deque<Readback> pending;		// oldest first
+	std::vector<GLuint> freeBuffers;	// pixel buffers not being read into
+	std::size_t captured = 0;
+
+	std::thread writer;
+	std::mutex mutex;					// guards everything below
+	std::condition_variable changed;
+	std::deque<Frame> queue;			// frames to write, oldest first
+	std::vector<std::vector<unsigned char>> spare;	// pixel arrays already written, reused
+	std::size_t written = 0;
+	std::size_t failed = 0;				// frames dropped: failed readbacks and writes
+	bool stopping = false;
+
+	/**
+	* @brief Copies the frames whose readback has finished out of their pixel buffers and queues them
+	* for the writer. Needs the GL context.
+	*
+	* @param wait - Whether to wait for the readbacks still running.
+	*
+	* @return void
+	*/
+	void collect(bool);
+
+	/**
+	* @brief Writes the queued frames until stopped, on the writer thread.
+	*
+	* @return void
+	*/
+	void writeLoop();
+
+	/**
+	* @brief Encodes and writes a frame to its file.
+	*
+	* @param frame - The frame.
+	*
+	* @return bool Whether the file was written.
+	*/
+	bool write(Frame const&) const;
+
+public:
+	/**
+	* @brief Constructor, creates the framebuffer object. Needs the GL context.
+	*
+	* @param width - The width of the frames in pixels.
+	* @param height - The height of the frames in pixels.
+	* @param directory - The existing directory the frames are written to.
+	* @param format - The file format of the frames.
+	*/
+	FrameRecorder(int, int, std::string, Format);
+	FrameRecorder(const FrameRecorder&) = delete;
+	FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+	/**
+	* @brief Writes the frames still in flight and deletes the GL objects. Needs the GL context.
+	*/
+	~FrameRecorder();
+
+	/**
+	* @brief Whether the framebuffer object could be created.
+	*/
+	bool valid() const {
+		return this->framebuffer != 0;
+	}
+
+	/**
+	* @brief Makes the framebuffer object the render target. Needs the GL context.
+	*
+	* @return void
+	*/
+	void bind();
+
+	/**
+	* @brief Starts the readback of the frame just rendered and hands the finished ones to the writer.
+	* Needs the GL context.
+	*
+	* @return void
+	*/
+	void capture();
+
+	/**
+	* @brief Waits until every captured frame is written. Needs the GL context.
+	*
+	* @return std::size_t The number of frames written.
+	*/
+	std::size_t finish();
+
+	/**
+	* @brief Number of frames captured so far.
+	*/
+	std::size_t frameCount() const {
+		return this->captured;
+	}
+};
@@ -0,0 +1,127 @@
+#include "GpuProfiler.hpp"
+
+#include "../third_party/imgui/imgui.h"
+
+namespace {
+    const char* PASS_NAMES[] = {
+        "Boids",
+        "Terrain",
+        "Obstacles",
+        "Cubemap",
+        "GUI"
+    };
+    static_assert(sizeof(PASS_NAMES) / sizeof(PASS_NAMES[0]) == (std::size_t)GpuPass::Count,
+        "Every GPU pass needs a name");
+}
+
+GpuProfiler& GpuProfiler::get()
+{
+    static GpuProfiler profiler;
+    return profiler;
+}
+
+const char* GpuProfiler::passName(GpuPass pass)
+{
+    return PASS_NAMES[(std::size_t)pass];
+}
+
+void GpuProfiler::init()
+{
+    for (std::size_t i = 0; i < FRAMES; i++)
+        glGenQueries(PASS_COUNT, this->queries[i]);
+    this->initialized = true;
+}
+
+void GpuProfiler::cleanup()
+{
+    if (!this->initialized)
+        return;
+    for (std::size_t i = 0; i < FRAMES; i++)
+        glDeleteQueries(PASS_COUNT, this->queries[i]);
+    this->initialized = false;
+}
+
+void GpuProfiler::beginPass(GpuPass pass)
+{
+    if (!this->initialized || this->activePass != GpuPass::Count)
+        return;
+    glBeginQuery(GL_TIME_ELAPSED, this->queries[this->frame][(std::size_t)pass]);
+    this->issued[this->frame][(std::size_t)pass] = true;
+    this->activePass = pass;
+}
+
+void GpuProfiler::endPass()
+{
+    if (this->activePass == GpuPass::Count)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    this->activePass = GpuPass::Count;
+}
+
+void GpuProfiler::endFrame()
+{
+    this->lastStats = this->stats;
+    this->stats = RenderStats{};
+
+    if (!this->initialized)
+        return;
+
+    // Read the other set of queries, issued a frame earlier; results that are not
+    // available yet are dropped and counted instead of waited for
+    this->frame = (this->frame + 1) % FRAMES;
+    for (std::size_t i = 0; i < PASS_COUNT; i++) {
+        this->passTimes[i] = 0.f;
+        this->measured[i] = false;
+        if (!this->issued[this->frame][i])
+            continue;
+        GLint available = 0;
+        glGetQueryObjectiv(this->queries[this->frame][i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(this->queries[this->frame][i], GL_QUERY_RESULT, &elapsed);
+            this->passTimes[i] = elapsed / 1e6f;
+            this->measured[i] = true;
+        }
+        else {
+            this->droppedResults++;
+        }
+        this->issued[this->frame][i] = false;
+    }
+}
+
+void GpuProfiler::drawGui()
+{
+    float total = 0.f;
+    ImGui::Columns(2, "gpuprofiler");
+    ImGui::SetColumnWidth(0, 250);
+    for (std::size_t i = 0; i < PASS_COUNT; i++) {
+        ImGui::Text("GPU %s", PASS_NAMES[i]);
+        ImGui::NextColumn();
+        if (this->measured[i])
+            ImGui::Text("%.3f ms", this->passTimes[i]);
+        else
+            ImGui::Text("n/a");
+        ImGui::NextColumn();
+        total += this->passTimes[i];
+    }
+    ImGui::Text("GPU total");
+    ImGui::NextColumn();
+    ImGui::Text("%.3f ms", total);
+    ImGui::NextColumn();
+    ImGui::Text("Results not ready, dropped");
+    ImGui::NextColumn();
+    ImGui::Text("%llu", this->droppedResults);
+    ImGui::NextColumn();
+    ImGui::Separator();
+
+    ImGui::Text("Draw calls");
+    ImGui::Text("State changes");
+    ImGui::Text("Uniform uploads");
+    ImGui::Text("Vertices submitted");
+    ImGui::NextColumn();
+    ImGui::Text("%u", this->lastStats.drawCalls);
+    ImGui::Text("%u", this->lastStats.stateChanges);
+    ImGui::Text("%u", this->lastStats.uniformUploads);
+    ImGui::Text("%llu", this->lastStats.vertices);
+    ImGui::Columns(1);
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <glad.h>
+
+#include <cstddef>
+
+/**
+* @brief The render passes timed on the GPU.
+*/
+enum class GpuPass : unsigned int {
+	Boids,
+	Terrain,
+	Obstacles,
+	Cubemap,
+	GUI,
+	Count
+};
+
+/**
+* @brief Counters of the work submitted to the GPU during a frame.
+*/
+struct RenderStats {
+	unsigned int drawCalls = 0;
+	unsigned int stateChanges = 0;		// calls issued through gl_state_change
+	unsigned int uniformUploads = 0;	// calls issued through gl_uniform
+	unsigned long long vertices = 0;
+};
+
+/**
+* @brief Times the render passes with GL_TIME_ELAPSED queries and counts the submitted work.
+* The queries and counters are double-buffered: the results shown are the ones of an
+* earlier frame that are already available, so reading them never stalls the pipeline.
+*/
+class GpuProfiler {
+private:
+	static constexpr std::size_t FRAMES = 2;
+	static constexpr std::size_t PASS_COUNT = (std::size_t)GpuPass::Count;
+
+	GLuint queries[FRAMES][PASS_COUNT] = {};
+	bool issued[FRAMES][PASS_COUNT] = {};
+	std::size_t frame = 0;
+	bool initialized = false;
+	GpuPass activePass = GpuPass::Count;
+
+	// Pass times (in ms) of the frame read last, 0 for the passes without a result, and the counters of the previous frame
+	float passTimes[PASS_COUNT] = {};
+	bool measured[PASS_COUNT] = {};
+	unsigned long long droppedResults = 0;	// results not available when read, never shown
+	RenderStats lastStats;
+
+	GpuProfiler() {};
+
+public:
+	// Counters of the frame being recorded, incremented by the render functions
+	RenderStats stats;
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	/**
+	* @brief Returns the GPU profiler shared by the whole application.
+	*/
+	static GpuProfiler& get();
+
+	/**
+	* @brief Returns the name of a timed pass.
+	*/
+	static const char* passName(GpuPass);
+
+	/**
+	* @brief Creates the query objects. Needs a current OpenGL context.
+	*
+	* @return void
+	*/
+	void init();
+
+	/**
+	* @brief Deletes the query objects. Must be called before the OpenGL context is destroyed.
+	*
+	* @return void
+	*/
+	void cleanup();
+
+	/**
+	* @brief Starts timing a pass. Passes cannot be nested.
+	*
+	* @param pass - The pass to time.
+	*
+	* @return void
+	*/
+	void beginPass(GpuPass);
+
+	/**
+	* @brief Stops timing the current pass.
+	*
+	* @return void
+	*/
+	void endPass();
+
+	/**
+	* @brief Collects the query results of the frame issued before the last one and swaps the counters.
+	* The passes that frame did not issue, and the ones whose result is not available yet, get no time.
+	* Must be called once per frame, after the last pass.
+	*
+	* @return void
+	*/
+	void endFrame();
+
+	/**
+	* @brief GPU time of a pass in the frame read last, in milliseconds, 0 if it has no result (see hasPassTime).
+	*/
+	float passTime(GpuPass pass) const {
+		return passTimes[(std::size_t)pass];
+	}
+
+	/**
+	* @brief Whether a pass was issued in the frame read last and its result was available.
+	*/
+	bool hasPassTime(GpuPass pass) const {
+		return measured[(std::size_t)pass];
+	}
+
+	/**
+	* @brief Number of query results dropped since init() because they were not available when read.
+	*/
+	unsigned long long droppedResultCount() const {
+		return droppedResults;
+	}
+
+	/**
+	* @brief Counters of the last complete frame.
+	*/
+	RenderStats const& frameStats() const {
+		return lastStats;
+	}
+
+	/**
+	* @brief Draws the pass times and counters in the current ImGui window.
+	*
+	* @return void
+	*/
+	void drawGui();
+};
+
+/**
+* @brief Times the enclosing scope as a GPU pass.
+*/
+class GpuPassScope {
+public:
+	GpuPassScope(GpuPass pass) {
+		GpuProfiler::get().beginPass(pass);
+	}
+
+	~GpuPassScope() {
+		GpuProfiler::get().endPass();
+	}
+};
+
+/**
+* @brief Issues a GL call that changes the bound state (program, vertex array, buffer, texture
+* or fixed-function state) and counts it in the render stats of the frame.
+*
+* @param function - The GL function, e.g. glUseProgram.
+* @param arguments - Its arguments.
+*
+* @return void
+*/
+template<class Function, class... Arguments>
+void gl_state_change(Function function, Arguments... arguments) {
+	function(arguments...);
+	GpuProfiler::get().stats.stateChanges++;
+}
+
+/**
+* @brief Issues a glUniform* call and counts it in the render stats of the frame.
+*
+* @param function - The GL function, e.g. glUniform3f.
+* @param arguments - Its arguments.
+*
+* @return void
+*/
+template<class Function, class... Arguments>
+void gl_uniform(Function function, Arguments... arguments) {
+	function(arguments...);
+	GpuProfiler::get().stats.uniformUploads++;
+}
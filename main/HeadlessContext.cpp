@@ -0,0 +1,187 @@
+#include "HeadlessContext.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__linux__)
+#include <dlfcn.h>
+
+namespace {
+    // The few EGL types and values used here, so that the EGL headers are not needed to build
+    using EGLint = int32_t;
+    using EGLBoolean = unsigned int;
+    using EGLenum = unsigned int;
+
+    constexpr EGLint EGL_NONE = 0x3038;
+    constexpr EGLint EGL_EXTENSIONS = 0x3055;
+    constexpr EGLint EGL_SURFACE_TYPE = 0x3033;
+    constexpr EGLint EGL_PBUFFER_BIT = 0x0001;
+    constexpr EGLint EGL_RENDERABLE_TYPE = 0x3040;
+    constexpr EGLint EGL_OPENGL_BIT = 0x0008;
+    constexpr EGLenum EGL_OPENGL_API = 0x30A2;
+    constexpr EGLint EGL_CONTEXT_MAJOR_VERSION = 0x3098;
+    constexpr EGLint EGL_CONTEXT_MINOR_VERSION = 0x30FB;
+    constexpr EGLint EGL_CONTEXT_OPENGL_PROFILE_MASK = 0x30FD;
+    constexpr EGLint EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT = 0x0001;
+    constexpr EGLint EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE = 0x31B1;
+    constexpr EGLenum EGL_PLATFORM_SURFACELESS_MESA = 0x31DD;
+
+    using GetProcAddress = void* (*)(const char*);
+    using GetPlatformDisplay = void* (*)(EGLenum, void*, EGLint const*);
+    using GetDisplay = void* (*)(void*);
+    using Initialize = EGLBoolean (*)(void*, EGLint*, EGLint*);
+    using Terminate = EGLBoolean (*)(void*);
+    using QueryString = char const* (*)(void*, EGLint);
+    using ChooseConfig = EGLBoolean (*)(void*, EGLint const*, void**, EGLint, EGLint*);
+    using BindAPI = EGLBoolean (*)(EGLenum);
+    using CreateContext = void* (*)(void*, void*, void*, EGLint const*);
+    using DestroyContext = EGLBoolean (*)(void*, void*);
+    using MakeCurrent = EGLBoolean (*)(void*, void*, void*, void*);
+    using GetError = EGLint (*)();
+
+    // eglGetProcAddress of the loaded library, for getProcAddress
+    GetProcAddress eglGetProcAddress = nullptr;
+
+    template<class Function>
+    Function load(void* library, const char* name)
+    {
+        return reinterpret_cast<Function>(dlsym(library, name));
+    }
+
+    bool hasExtension(char const* extensions, char const* name)
+    {
+        std::size_t length = std::strlen(name);
+        for (char const* at = extensions; at && (at = std::strstr(at, name)) != nullptr; at += length) {
+            if ((at == extensions || at[-1] == ' ') && (at[length] == ' ' || at[length] == '\0'))
+                return true;
+        }
+        return false;
+    }
+}
+
+bool HeadlessContext::create(int major, int minor)
+{
+    destroy();
+
+    this->library = dlopen("libEGL.so.1", RTLD_LAZY | RTLD_LOCAL);
+    if (!this->library)
+        this->library = dlopen("libEGL.so", RTLD_LAZY | RTLD_LOCAL);
+    if (!this->library) {
+        std::printf("Headless context: libEGL not found\n");
+        return false;
+    }
+
+    eglGetProcAddress = load<GetProcAddress>(this->library, "eglGetProcAddress");
+    auto getDisplay = load<GetDisplay>(this->library, "eglGetDisplay");
+    auto initialize = load<Initialize>(this->library, "eglInitialize");
+    auto queryString = load<QueryString>(this->library, "eglQueryString");
+    auto chooseConfig = load<ChooseConfig>(this->library, "eglChooseConfig");
+    auto bindAPI = load<BindAPI>(this->library, "eglBindAPI");
+    auto createContext = load<CreateContext>(this->library, "eglCreateContext");
+    auto makeCurrent = load<MakeCurrent>(this->library, "eglMakeCurrent");
+    auto getError = load<GetError>(this->library, "eglGetError");
+    if (!eglGetProcAddress || !getDisplay || !initialize || !queryString || !chooseConfig || !bindAPI
+        || !createContext || !makeCurrent || !getError) {
+        std::printf("Headless context: libEGL is incomplete\n");
+        destroy();
+        return false;
+    }
+
+    // Mesa's surfaceless platform needs no display server; other EGL implementations
+    // may still give a display without one
+    char const* clientExtensions = queryString(nullptr, EGL_EXTENSIONS);
+    auto getPlatformDisplay = (GetPlatformDisplay)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay && hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+        this->display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, nullptr, nullptr);
+    if (!this->display)
+        this->display = getDisplay(nullptr);
+
+    EGLint versionMajor = 0, versionMinor = 0;
+    if (!this->display || !initialize(this->display, &versionMajor, &versionMinor)) {
+        std::printf("Headless context: no EGL display (error 0x%x)\n", getError());
+        destroy();
+        return false;
+    }
+
+    // Drawing without any surface needs EGL_KHR_surfaceless_context
+    char const* extensions = queryString(this->display, EGL_EXTENSIONS);
+    if (!hasExtension(extensions, "EGL_KHR_surfaceless_context")) {
+        std::printf("Headless context: EGL_KHR_surfaceless_context is not supported\n");
+        destroy();
+        return false;
+    }
+
+    // Any config renders into framebuffer objects; without one, EGL_KHR_no_config_context may do
+    EGLint const configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    void* config = nullptr;
+    EGLint configCount = 0;
+    chooseConfig(this->display, configAttributes, &config, 1, &configCount);
+    if (configCount == 0)
+        config = nullptr;
+
+    EGLint const contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, major,
+        EGL_CONTEXT_MINOR_VERSION, minor,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, 1,
+        EGL_NONE
+    };
+    bindAPI(EGL_OPENGL_API);
+    this->context = createContext(this->display, config, nullptr, contextAttributes);
+    if (!this->context || !makeCurrent(this->display, nullptr, nullptr, this->context)) {
+        std::printf("Headless context: cannot create an OpenGL %d.%d core context (error 0x%x)\n", major, minor, getError());
+        destroy();
+        return false;
+    }
+
+    std::printf("Headless context: EGL %d.%d\n", versionMajor, versionMinor);
+    return true;
+}
+
+void HeadlessContext::destroy()
+{
+    if (this->library) {
+        if (this->display) {
+            auto makeCurrent = load<MakeCurrent>(this->library, "eglMakeCurrent");
+            auto destroyContext = load<DestroyContext>(this->library, "eglDestroyContext");
+            auto terminate = load<Terminate>(this->library, "eglTerminate");
+            if (this->context) {
+                makeCurrent(this->display, nullptr, nullptr, nullptr);
+                destroyContext(this->display, this->context);
+            }
+            terminate(this->display);
+        }
+        dlclose(this->library);
+    }
+    this->library = this->display = this->context = nullptr;
+    eglGetProcAddress = nullptr;
+}
+
+void* HeadlessContext::getProcAddress(const char* name)
+{
+    return eglGetProcAddress ? eglGetProcAddress(name) : nullptr;
+}
+
+#else
+
+bool HeadlessContext::create(int, int)
+{
+    std::printf("Headless context: only supported on Linux\n");
+    return false;
+}
+
+void HeadlessContext::destroy()
+{
+}
+
+void* HeadlessContext::getProcAddress(const char*)
+{
+    return nullptr;
+}
+
+#endif
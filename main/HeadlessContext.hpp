@@ -0,0 +1,49 @@
+#pragma once
+
+/**
+* @brief OpenGL context without a window or a display, for rendering on machines with no
+* screen, e.g. with Mesa's llvmpipe. Created with EGL on Mesa's surfaceless platform: the
+* context has no default framebuffer, so everything is drawn into framebuffer objects.
+* libEGL is loaded at run time, so the application does not depend on it to start;
+* creation fails where it is missing, and on platforms other than Linux.
+*/
+class HeadlessContext {
+private:
+	void* library = nullptr;
+	void* display = nullptr;
+	void* context = nullptr;
+
+	/**
+	* @brief Releases the context and the display.
+	*
+	* @return void
+	*/
+	void destroy();
+
+public:
+	HeadlessContext() {};
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+	~HeadlessContext() {
+		destroy();
+	};
+
+	/**
+	* @brief Creates a core profile context of the given version and makes it current on the calling thread.
+	*
+	* @param major - The major OpenGL version.
+	* @param minor - The minor OpenGL version.
+	*
+	* @return bool True on success, false (with a message) otherwise.
+	*/
+	bool create(int, int);
+
+	/**
+	* @brief Returns the address of a GL function of the created context, e.g. for gladLoadGLLoader.
+	*
+	* @param name - The name of the function.
+	*
+	* @return The address of the function, null if not found or if no context was created.
+	*/
+	static void* getProcAddress(const char*);
+};
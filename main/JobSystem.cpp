@@ -0,0 +1,168 @@
+#include "JobSystem.hpp"
+
+namespace {
+    // Deque of the calling thread: its own for the pool threads, 0 for the others
+    thread_local std::size_t workerIndex = 0;
+
+    // Where thieves start looking, so that they do not all hit the same deque
+    thread_local std::size_t stealCursor = 0;
+}
+
+JobSystem::JobSystem()
+{
+    std::size_t hardwareThreads = std::thread::hardware_concurrency();
+    std::size_t count = hardwareThreads > 1 ? hardwareThreads : 1;
+    for (std::size_t i = 0; i < count; i++)
+        this->workers.push_back(std::make_unique<Worker>());
+
+    // Deque 0 belongs to the threads outside the pool, which also run jobs while they wait
+    for (std::size_t i = 1; i < count; i++)
+        this->threads.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->sleepMutex);
+        this->running = false;
+    }
+    this->wake.notify_all();
+    for (std::thread& thread : this->threads)
+        thread.join();
+}
+
+JobSystem& JobSystem::get()
+{
+    static JobSystem jobSystem;
+    return jobSystem;
+}
+
+void JobSystem::enqueue(std::shared_ptr<Job> job)
+{
+    Worker& worker = job->queue == Queue::Background ? this->background : *this->workers[workerIndex];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.jobs.push_back(std::move(job));
+    }
+    // Taking the sleep mutex orders the count with the check of a thread about to sleep
+    {
+        std::lock_guard<std::mutex> lock(this->sleepMutex);
+        this->queued++;
+    }
+    this->wake.notify_one();
+}
+
+bool JobSystem::runOne(bool background)
+{
+    std::shared_ptr<Job> job;
+
+    // Newest job of our own deque first...
+    Worker& own = *this->workers[workerIndex];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+        }
+    }
+
+    // ...then the oldest job of another one, which tends to be the largest piece of work left
+    for (std::size_t i = 0; !job && i < this->workers.size(); i++) {
+        Worker& victim = *this->workers[(stealCursor + i) % this->workers.size()];
+        if (&victim == &own)
+            continue;
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            stealCursor = (stealCursor + i) % this->workers.size();
+        }
+    }
+
+    // ...and the background work last, oldest first
+    if (!job && background) {
+        std::lock_guard<std::mutex> lock(this->background.mutex);
+        if (!this->background.jobs.empty()) {
+            job = std::move(this->background.jobs.front());
+            this->background.jobs.pop_front();
+        }
+    }
+
+    if (!job)
+        return false;
+    this->queued--;
+    execute(job);
+    return true;
+}
+
+void JobSystem::execute(std::shared_ptr<Job> const& job)
+{
+    job->work();
+    job->work = nullptr;
+
+    std::vector<std::shared_ptr<Job>> dependents;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done = true;
+        dependents.swap(job->dependents);
+    }
+    for (std::shared_ptr<Job>& dependent : dependents) {
+        if (--dependent->blockers == 0)
+            enqueue(std::move(dependent));
+    }
+}
+
+void JobSystem::workerLoop(std::size_t index)
+{
+    workerIndex = index;
+    stealCursor = index;
+    while (this->running) {
+        if (runOne(true))
+            continue;
+        std::unique_lock<std::mutex> lock(this->sleepMutex);
+        this->wake.wait(lock, [this]() { return this->queued > 0 || !this->running; });
+    }
+}
+
+JobSystem::JobHandle JobSystem::submit(std::function<void()> work, std::vector<JobHandle> const& dependencies, Queue queue)
+{
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->work = std::move(work);
+    job->queue = queue;
+    for (JobHandle const& dependency : dependencies) {
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (!dependency->done) {
+            job->blockers++;
+            dependency->dependents.push_back(job);
+        }
+    }
+
+    // Release the guard: queue the job now if it does not wait for anything
+    if (--job->blockers == 0)
+        enqueue(job);
+    return job;
+}
+
+void JobSystem::wait(JobHandle const& job)
+{
+    bool background = job->queue == Queue::Background;
+    while (!job->done) {
+        if (!runOne(background))
+            std::this_thread::yield();
+    }
+}
+
+bool JobSystem::runBackground()
+{
+    std::shared_ptr<Job> job;
+    {
+        std::lock_guard<std::mutex> lock(this->background.mutex);
+        if (this->background.jobs.empty())
+            return false;
+        job = std::move(this->background.jobs.front());
+        this->background.jobs.pop_front();
+    }
+    this->queued--;
+    execute(job);
+    return true;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* @brief Work-stealing task scheduler shared by the simulation and the asset loading.
+* Every thread of the pool owns a deque of jobs: it pushes and pops its own jobs at the
+* back, so it works depth-first on cache-warm data, and steals from the front of the
+* deques of the others when its own is empty. Threads outside the pool (the main thread)
+* share deque 0. A job can depend on other jobs and only starts once they are finished.
+* A thread waiting for a job runs other jobs in the meantime, so jobs can wait for
+* jobs (e.g. nested parallel loops) without starving the pool.
+* Background jobs (e.g. asset decoding) go to a separate queue, drained in order by the pool
+* threads only: a thread waiting for a frame job never runs them, so a long decode cannot
+* stall the frame. Only a thread waiting for a background job helps with that queue.
+*/
+class JobSystem {
+public:
+	enum class Queue {
+		Frame,		// work the submitting thread waits for soon, e.g. the ranges of a parallel loop
+		Background	// long work nobody waits for in a frame, e.g. decoding an asset
+	};
+
+private:
+	struct Job {
+		std::function<void()> work;
+		Queue queue = Queue::Frame;
+		std::atomic<int> blockers{ 1 };	// unfinished dependencies, plus one until submit() is done
+		std::atomic<bool> done{ false };
+		std::mutex mutex;				// guards dependents against the job finishing
+		std::vector<std::shared_ptr<Job>> dependents;
+	};
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<std::shared_ptr<Job>> jobs;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	Worker background;	// the background jobs, oldest first
+	std::vector<std::thread> threads;
+	std::atomic<bool> running{ true };
+
+	// Idle threads sleep until a job is queued
+	std::atomic<int> queued{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+
+	JobSystem();
+
+	/**
+	* @brief Queues a job whose dependencies are all finished on the deque of the calling thread,
+	* or on the background queue.
+	*/
+	void enqueue(std::shared_ptr<Job>);
+
+	/**
+	* @brief Runs one queued job: the newest of the calling thread's deque, or the oldest of another one,
+	* or else the oldest background job if allowed.
+	*
+	* @param background - Whether a background job may be run.
+	*
+	* @return bool False if there was no job to run.
+	*/
+	bool runOne(bool);
+
+	/**
+	* @brief Runs a job and releases the jobs that depend on it.
+	*/
+	void execute(std::shared_ptr<Job> const&);
+
+	/**
+	* @brief Loop of the pool threads.
+	*/
+	void workerLoop(std::size_t);
+
+public:
+	// Reference to a submitted job, to wait for it or to make other jobs depend on it
+	using JobHandle = std::shared_ptr<Job>;
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+	~JobSystem();
+
+	static JobSystem& get();
+
+	/**
+	* @brief Number of threads running jobs: the pool and the calling thread.
+	*/
+	std::size_t threadCount() const {
+		return this->workers.size();
+	}
+
+	/**
+	* @brief Submits a job, started once all its dependencies are finished.
+	*
+	* @param work - The function to run.
+	* @param dependencies - The jobs that must finish first.
+	* @param queue - Whether the job is frame or background work.
+	*
+	* @return JobHandle The handle of the job.
+	*/
+	JobHandle submit(std::function<void()>, std::vector<JobHandle> const& dependencies = {}, Queue queue = Queue::Frame);
+
+	/**
+	* @brief Runs other jobs until a job is finished: frame jobs, and background jobs too if the job
+	* waited for is one.
+	*
+	* @param job - The job to wait for.
+	*
+	* @return void
+	*/
+	void wait(JobHandle const&);
+
+	/**
+	* @brief Runs the oldest background job on the calling thread, if any. For machines
+	* without pool threads, where nothing else would run them.
+	*
+	* @return bool False if there was no background job to run.
+	*/
+	bool runBackground();
+
+	/**
+	* @brief Splits [0, count) into ranges of at least grain items, runs body(begin, end) on every
+	* range across the pool and returns once they are all done. Small loops run inline.
+	*
+	* @param count - The number of items.
+	* @param grain - The minimum number of items per job.
+	* @param body - Callable taking the std::size_t begin and end of a range.
+	*
+	* @return void
+	*/
+	template<class Body>
+	void parallelFor(std::size_t count, std::size_t grain, Body const& body) {
+		// A few ranges per thread, so that the threads that finish first can steal the rest
+		std::size_t ranges = grain > 0 ? count / grain : count;
+		std::size_t maxRanges = threadCount() * 4;
+		if (ranges > maxRanges)
+			ranges = maxRanges;
+		if (ranges <= 1) {
+			if (count > 0)
+				body((std::size_t)0, count);
+			return;
+		}
+
+		std::size_t size = (count + ranges - 1) / ranges;
+		std::vector<JobHandle> jobs;
+		jobs.reserve(ranges - 1);
+		for (std::size_t begin = size; begin < count; begin += size) {
+			std::size_t end = begin + size < count ? begin + size : count;
+			jobs.push_back(submit([&body, begin, end]() { body(begin, end); }));
+		}
+		body((std::size_t)0, size);
+		for (JobHandle const& job : jobs)
+			wait(job);
+	}
+};
@@ -1,75 +1,148 @@
 #include "Model.hpp"
+#include "GpuProfiler.hpp"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 #define POSITIONS 0
 #define NORMALS 1
-#define MAT_INDEXES 2
-
-
-void Model::setupRendering()
-{
-    std::vector<Vec3f> positions, normals;
-    for (Vertex const& v : this->vertices) {
-        positions.emplace_back(v.positions);
-        normals.emplace_back(v.normals);
+#define INSTANCE_TRANSFORMS 3	// 3 locations, one per matrix row
+#define INSTANCE_TAIL 6			// tail phase and amplitude
+
+// Uniform location of the normal matrix in the non-instanced shaders
+#define NORMAL_MATRIX 74
+
+// Uniform locations of the material ranges in the multimaterial shaders
+#define MATERIAL_COUNT 63
+#define MATERIAL_ENDS 64
+
+namespace {
+    // Converts a component in [-1, 1] to a signed normalized 10 bit integer
+    uint32_t packSnorm10(float value)
+    {
+        float clamped = value < -1.f ? -1.f : (value > 1.f ? 1.f : value);
+        int scaled = (int)std::lround(clamped * 511.f);
+        return (uint32_t)scaled & 0x3FF;
     }
 
-    // VBO
-    this->VBO.emplace_back();
-    glGenBuffers(1, &this->VBO.at(POSITIONS));
-    glBindBuffer(GL_ARRAY_BUFFER, this->VBO.at(POSITIONS));
-    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(Vec3f), positions.data(), GL_STATIC_DRAW);
-
-    this->VBO.emplace_back();
-    glGenBuffers(1, &this->VBO.at(NORMALS));
-    glBindBuffer(GL_ARRAY_BUFFER, this->VBO.at(NORMALS));
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(Vec3f), normals.data(), GL_STATIC_DRAW);
+    uint32_t packNormal(Vec3f normal)
+    {
+        // Only the direction matters, the shaders normalize after transforming it
+        float len = length(normal);
+        if (len > 0.f)
+            normal = normal / len;
+        return packSnorm10(normal.x) | (packSnorm10(normal.y) << 10) | (packSnorm10(normal.z) << 20);
+    }
+}
 
-    // VAO
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+PackedVertex pack_vertex(Vertex const& vertex)
+{
+    return PackedVertex{ vertex.positions, packNormal(vertex.normals) };
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, this->VBO.at(POSITIONS));
+void setup_packed_vertex_attributes()
+{
     glVertexAttribPointer(
         POSITIONS,	// location in .vert
         3, GL_FLOAT, GL_FALSE, // 3 floats for positions
-        0,	// no padding
-        (GLvoid*)0	// offset 0 in VBO
+        sizeof(PackedVertex),	// interleaved with the normals
+        (GLvoid*)offsetof(PackedVertex, position)
     );
     glEnableVertexAttribArray(POSITIONS);
 
-    glBindBuffer(GL_ARRAY_BUFFER, this->VBO.at(NORMALS));
     glVertexAttribPointer(
         NORMALS,	// location in .vert
-        3, GL_FLOAT, GL_FALSE, // 3 floats for normals
-        0,	// no padding
-        (GLvoid*)0	// offset 0 in VBO
+        4, GL_INT_2_10_10_10_REV, GL_TRUE, // 10 bits per component, normalized to [-1, 1]
+        sizeof(PackedVertex),	// interleaved with the positions
+        (GLvoid*)offsetof(PackedVertex, normal)
     );
     glEnableVertexAttribArray(NORMALS);
+}
+
+void upload_shading_uniforms(GLuint shaderProg, Vec3f cameraPosition, Light const& light, std::vector<Material> const& materials)
+{
+    // material properties
+    for (unsigned int i = 0; i < materials.size(); i++) {
+        gl_uniform(glUniform3f, 3 + i * 6, materials.at(i).ambient.x, materials.at(i).ambient.y, materials.at(i).ambient.z);
+        gl_uniform(glUniform3f, 4 + i * 6, materials.at(i).diffuse.x, materials.at(i).diffuse.y, materials.at(i).diffuse.z);
+        gl_uniform(glUniform3f, 5 + i * 6, materials.at(i).specular.x, materials.at(i).specular.y, materials.at(i).specular.z);
+        gl_uniform(glUniform3f, 6 + i * 6, materials.at(i).emission.x, materials.at(i).emission.y, materials.at(i).emission.z);
+        gl_uniform(glUniform1f, 7 + i * 6, materials.at(i).shininess);
+        gl_uniform(glUniform1f, 8 + i * 6, materials.at(i).alpha);
+    }
+
+    gl_uniform(glUniform3f, 2, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+
+    GLuint loc;
+    loc = glGetUniformLocation(shaderProg, "light.Position");
+    gl_uniform(glUniform3f, loc, light.position.x, light.position.y, light.position.z);
+
+    loc = glGetUniformLocation(shaderProg, "light.Ambient");
+    gl_uniform(glUniform3f, loc, light.ambient.x, light.ambient.y, light.ambient.z);
 
-    if (materialIndexes.size() > 0) {
-        this->VBO.emplace_back();
-        glGenBuffers(1, &this->VBO.at(MAT_INDEXES));
-        glBindBuffer(GL_ARRAY_BUFFER, this->VBO.at(MAT_INDEXES));
-        glBufferData(GL_ARRAY_BUFFER, materialIndexes.size() * sizeof(int), materialIndexes.data(), GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ARRAY_BUFFER, this->VBO.at(MAT_INDEXES));
-        glVertexAttribIPointer(
-		    MAT_INDEXES,	// location in .vert
-		    1, GL_INT,	// 1 int for material index
-            0,	// no padding
-		    (GLvoid*)0	// offset 0 in VBO
-	    );
-        glEnableVertexAttribArray(MAT_INDEXES);
+    loc = glGetUniformLocation(shaderProg, "light.Color");
+    gl_uniform(glUniform3f, loc, light.color.x, light.color.y, light.color.z);
+
+    loc = glGetUniformLocation(shaderProg, "light.Strength");
+    gl_uniform(glUniform1f, loc, light.strength);
+}
+
+void Model::setupRendering()
+{
+    // Group the triangles by material, keeping their order within a material, so that a
+    // material is a range of vertices instead of an attribute of every vertex
+    this->materialEnds.assign(this->materials.size(), (GLint)this->vertices.size());
+    if (this->materials.size() > 1 && this->materialIndexes.size() == this->vertices.size()) {
+        std::vector<GLint> starts(this->materials.size() + 1, 0);
+        auto materialOf = [this](std::size_t vertex) {
+            unsigned int material = this->materialIndexes[vertex];
+            return material < this->materials.size() ? material : 0u;
+        };
+        for (std::size_t v = 0; v < this->vertices.size(); v += 3)
+            starts[materialOf(v) + 1] += 3;
+        for (std::size_t m = 0; m < this->materials.size(); m++) {
+            starts[m + 1] += starts[m];
+            this->materialEnds[m] = starts[m + 1];
+        }
+
+        std::vector<Vertex> grouped(this->vertices.size());
+        std::vector<unsigned int> groupedIndexes(this->vertices.size());
+        for (std::size_t v = 0; v + 2 < this->vertices.size(); v += 3) {
+            unsigned int material = materialOf(v);
+            GLint destination = starts[material];
+            starts[material] += 3;
+            for (std::size_t corner = 0; corner < 3; corner++) {
+                grouped[destination + corner] = this->vertices[v + corner];
+                groupedIndexes[destination + corner] = material;
+            }
+        }
+        this->vertices.swap(grouped);
+        this->materialIndexes.swap(groupedIndexes);
     }
 
+    std::vector<PackedVertex> packed;
+    packed.reserve(this->vertices.size());
+    for (Vertex const& v : this->vertices)
+        packed.push_back(pack_vertex(v));
+
+    // VBO
+    glGenBuffers(1, &this->VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+    glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex), packed.data(), GL_STATIC_DRAW);
+
+    // VAO
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    setup_packed_vertex_attributes();
+
     // Reset state
-    glEnableVertexAttribArray(0);
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void Model::render(Vec3f cameraPosition, Light light, Mat44f world2projection, Mat44f givenModel2world, GLuint shaderProgs[])
+void Model::useProgram(GLuint shaderProgs[], Vec3f cameraPosition, Light const& light, Mat44f const& world2projection)
 {
     GLuint shaderProg;
     if (materials.size() == 1)
@@ -77,49 +150,97 @@ void Model::render(Vec3f cameraPosition, Light light, Mat44f world2projection, M
     else
         shaderProg = shaderProgs[1];
     
-    glUseProgram(shaderProg);
+    gl_state_change(glUseProgram, shaderProg);
     
-    glUniformMatrix4fv(
+    gl_uniform(glUniformMatrix4fv,
         0,
         1, GL_TRUE, world2projection.v
     );
 
 
-    // material properties
-    for (unsigned int i = 0; i < materials.size(); i++) {
-        glUniform3f(3 + i * 6, materials.at(i).ambient.x, materials.at(i).ambient.y, materials.at(i).ambient.z);
-        glUniform3f(4 + i * 6, materials.at(i).diffuse.x, materials.at(i).diffuse.y, materials.at(i).diffuse.z);
-        glUniform3f(5 + i * 6, materials.at(i).specular.x, materials.at(i).specular.y, materials.at(i).specular.z);
-        glUniform3f(6 + i * 6, materials.at(i).emission.x, materials.at(i).emission.y, materials.at(i).emission.z);
-        glUniform1f(7 + i * 6, materials.at(i).shininess);
-        glUniform1f(8 + i * 6, materials.at(i).alpha);
+    upload_shading_uniforms(shaderProg, cameraPosition, light, materials);
+
+    // Vertex ranges of the materials
+    if (materials.size() > 1) {
+        gl_uniform(glUniform1i, MATERIAL_COUNT, (GLint)materials.size());
+        gl_uniform(glUniform1iv, MATERIAL_ENDS, (GLsizei)materialEnds.size(), materialEnds.data());
     }
+}
 
-    glUniformMatrix4fv(
+void Model::render(Vec3f cameraPosition, Light light, Mat44f world2projection, Mat44f givenModel2world, GLuint shaderProgs[])
+{
+    useProgram(shaderProgs, cameraPosition, light, world2projection);
+
+    gl_uniform(glUniformMatrix4fv,
         1,
         1, GL_TRUE, givenModel2world.v
     );
 
-    glUniform3f(2, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+    // Inverted once per draw rather than for every vertex in the shader
+    Mat33f const normalMatrix = mat33(transpose(invert(givenModel2world)));
+    gl_uniform(glUniformMatrix3fv,
+        NORMAL_MATRIX,
+        1, GL_TRUE, normalMatrix.v
+    );
 
-    GLuint loc;
-    loc = glGetUniformLocation(shaderProg, "light.Position");
-    glUniform3f(loc, light.position.x, light.position.y, light.position.z);
+    gl_state_change(glBindVertexArray, this->VAO);
+    glDrawArrays(GL_TRIANGLES, 0, this->vertices.size());
 
-    loc = glGetUniformLocation(shaderProg, "light.Ambient");
-    glUniform3f(loc, light.ambient.x, light.ambient.y, light.ambient.z);
+    RenderStats& stats = GpuProfiler::get().stats;
+    stats.drawCalls++;
+    stats.vertices += this->vertices.size();
 
-    loc = glGetUniformLocation(shaderProg, "light.Color");
-    glUniform3f(loc, light.color.x, light.color.y, light.color.z);
+    // Reset state
+    glEnableVertexAttribArray(0);
+    gl_state_change(glBindVertexArray, 0);
+    gl_state_change(glBindBuffer, GL_ARRAY_BUFFER, 0);
+}
 
-    loc = glGetUniformLocation(shaderProg, "light.Strength");
-    glUniform1f(loc, light.strength);
+void Model::renderInstanced(Vec3f cameraPosition, Light light, Mat44f world2projection, std::size_t count, GLuint shaderProgs[])
+{
+    if (count == 0)
+        return;
+
+    this->instances.commit();
+    gl_state_change(glBindVertexArray, this->VAO);
+
+    // The instance buffer is recreated when it grows
+    if (this->instanceAllocation != this->instances.allocationCount()) {
+        this->instanceAllocation = this->instances.allocationCount();
+        gl_state_change(glBindBuffer, GL_ARRAY_BUFFER, this->instances.id());
+
+        // The 3 rows of the affine model2world matrix and the tail animation, advancing once per instance
+        for (GLuint row = 0; row < 3; row++) {
+            glVertexAttribPointer(
+                INSTANCE_TRANSFORMS + row,	// location in .vert
+                4, GL_FLOAT, GL_FALSE, // 4 floats per row
+                sizeof(InstanceData),	// one matrix per instance
+                (GLvoid*)(offsetof(InstanceData, model2world) + row * 4 * sizeof(float))	// offset of the row
+            );
+            glVertexAttribDivisor(INSTANCE_TRANSFORMS + row, 1);
+            glEnableVertexAttribArray(INSTANCE_TRANSFORMS + row);
+        }
+        glVertexAttribPointer(
+            INSTANCE_TAIL,	// location in .vert
+            2, GL_FLOAT, GL_FALSE, // phase and amplitude
+            sizeof(InstanceData),	// one per instance
+            (GLvoid*)offsetof(InstanceData, tailPhase)
+        );
+        glVertexAttribDivisor(INSTANCE_TAIL, 1);
+        glEnableVertexAttribArray(INSTANCE_TAIL);
+    }
 
-    glBindVertexArray(this->VAO);
-    glDrawArrays(GL_TRIANGLES, 0, this->vertices.size());
+    // The base instance selects this frame's region of the instance buffer
+    useProgram(shaderProgs, cameraPosition, light, world2projection);
+    glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, (GLsizei)this->vertices.size(), (GLsizei)count,
+        (GLuint)this->instances.firstElement());
+    this->instances.fence();
+
+    RenderStats& stats = GpuProfiler::get().stats;
+    stats.drawCalls++;
+    stats.vertices += this->vertices.size() * count;
 
     // Reset state
-    glEnableVertexAttribArray(0);
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    gl_state_change(glBindVertexArray, 0);
+    gl_state_change(glBindBuffer, GL_ARRAY_BUFFER, 0);
 }
@@ -2,12 +2,14 @@
 
 #include <glad.h>
 #include "Shader.hpp"
+#include "StreamBuffer.hpp"
 
 #include "../math/mat44.hpp"
 #include "../math/mat33.hpp"
 #include "../math/vec3.hpp"
 #include "../math/vec2.hpp"
 
+#include <cstdint>
 #include <cstdlib>
 #include <ctime>
 #include <string>
@@ -22,6 +24,44 @@ struct Vertex {
 	Vec2f texCoords;
 };
 
+/**
+* @brief A vertex as uploaded to the GPU: 16 bytes, interleaved.
+*/
+struct PackedVertex {
+	Vec3f position;
+	uint32_t normal;	// GL_INT_2_10_10_10_REV: x in the low bits, w unused
+};
+
+/**
+* @brief Per-instance data of Model::renderInstanced, 64 bytes.
+* The model2world matrix must be rigid (rotation and translation), so that its 3x3 part is also
+* the normal matrix. The instanced shaders animate the tail of the model in model space: a shear
+* of tailAmplitude * sin(2 pi tailPhase), which the instances can each set to their own phase.
+*/
+struct InstanceData {
+	Mat34f model2world;
+	float tailPhase;		// in turns
+	float tailAmplitude;	// 0 for no animation
+	float padding[2];
+};
+
+/**
+* @brief Packs a vertex for the GPU, the normal normalized to 10 bits per component.
+*
+* @param vertex - The vertex to pack.
+*
+* @return The packed vertex.
+*/
+PackedVertex pack_vertex(Vertex const&);
+
+/**
+* @brief Sets the position and normal attributes of the bound VAO to read PackedVertex
+* from the bound GL_ARRAY_BUFFER.
+*
+* @return void
+*/
+void setup_packed_vertex_attributes();
+
 /**
 * @brief A material struct containing the parameters of a material used in the Blinn-Phong model.
 */
@@ -34,6 +74,16 @@ struct Material {
 	float alpha = 1.f;
 };
 
+/**
+* @brief The CPU side of a model: what the loaders produce, without any GL object,
+* so that it can be built on any thread and turned into a Model on the GL thread.
+*/
+struct MeshData {
+	std::vector<Vertex> vertices;
+	std::vector<Material> materials;
+	std::vector<unsigned int> materialIndexes;	// per vertex, empty for a single material
+};
+
 /**
 * @brief A light struct containing the parameters of the light used in the Blinn-Phong model.
 */
@@ -44,26 +94,57 @@ struct Light {
 	float strength;
 };
 
+/**
+* @brief Uploads the uniforms of the Blinn-Phong shaders: materials, camera position and light.
+*
+* @param shaderProg - The bound shader program.
+* @param cameraPosition - The current camera position in world coordinates.
+* @param light - The light of the scene.
+* @param materials - The materials, at most 10.
+*
+* @return void
+*/
+void upload_shading_uniforms(GLuint, Vec3f, Light const&, std::vector<Material> const&);
+
 /**
 * @brief Representation of a 3D model.
 */
 class Model {
 private:
-	std::vector<GLuint> VBO;
+	GLuint VBO = 0;
 	GLuint VAO;
 
+	// End (one past the last vertex) of the vertices of each material, which setupRendering
+	// groups by material; the multimaterial shaders find the material of a vertex from them
+	std::vector<GLint> materialEnds;
+
+	// Per-instance transforms for renderInstanced, and the buffer the VAO reads them from
+	StreamBuffer instances{ sizeof(InstanceData) };
+	unsigned int instanceAllocation = 0;
+
 	/**
-	* @brief Deletes the VBOs and VAO buffers.
+	* @brief Deletes the VBO and VAO buffers.
 	* 
 	* @returns void
 	*/
 	void cleanup() {
-		for (GLuint vbo : VBO)
-			glDeleteBuffers(1, &vbo);
+		glDeleteBuffers(1, &VBO);
 
 		glDeleteVertexArrays(1, &VAO);
 	};
 
+	/**
+	* @brief Binds the shader program for this model and uploads the camera, light and material uniforms.
+	*
+	* @param shaderProgs - Array of 2 shaders: 0 - singlematerial, 1 - multimaterial
+	* @param cameraPosition - The current camera position in world coordinates.
+	* @param light - The light of the scene.
+	* @param world2projection - The product of the projection and world2camera matrices.
+	*
+	* @return void
+	*/
+	void useProgram(GLuint[], Vec3f, Light const&, Mat44f const&);
+
 public:
 	std::vector<Vertex> vertices;
 	std::vector<Material> materials;
@@ -90,12 +171,26 @@ public:
 		setupRendering();
 	}
 
+	/**
+	* @brief Constructor for a loaded mesh, with a default material if it has none.
+	*/
+	Model(MeshData mesh) {
+		this->vertices = std::move(mesh.vertices);
+		this->materials = std::move(mesh.materials);
+		if (this->materials.empty())
+			this->materials = { Material{} };
+		if (this->materials.size() > 1)
+			this->materialIndexes = std::move(mesh.materialIndexes);
+		setupRendering();
+	}
+
 	~Model() {
 		cleanup();
 	};
 	
 	/**
-	* @brief Sets up the VBOs and VAOs for rendering this model.
+	* @brief Sets up the VBO and VAO for rendering this model: the vertices are grouped by material
+	* and uploaded interleaved, as a float3 position and a normal packed in GL_INT_2_10_10_10_REV.
 	*
 	* @return void
 	*/
@@ -112,4 +207,37 @@ public:
 	* @return void
 	*/
 	void render(Vec3f, Light, Mat44f, Mat44f, GLuint[]);
+
+	/**
+	* @brief End (one past the last vertex) of the vertices of each material, in vertices.
+	*/
+	std::vector<GLint> const& getMaterialEnds() const {
+		return this->materialEnds;
+	}
+
+	/**
+	* @brief Returns where to write the data of this frame's instances: memory of the instance
+	* buffer itself, mapped for the GPU, which any thread can fill until renderInstanced is called.
+	* Needs the GL context.
+	*
+	* @param count - The number of instances.
+	*
+	* @return Pointer to the data of count instances.
+	*/
+	InstanceData* mapInstances(std::size_t count) {
+		return (InstanceData*)this->instances.begin(count);
+	}
+
+	/**
+	* @brief Renders count copies of the model in one draw call, each with the model2world
+	* matrix and tail animation written by mapInstances, using the instanced shader programs.
+	*
+	* @param cameraPosition - The current camera position in world coordinates.
+	* @param world2projection - The product of the projection and world2camera matrices.
+	* @param count - The number of instances, as given to mapInstances.
+	* @param shaderProgs - Array of 2 instanced shaders: 0 - singlematerial, 1 - multimaterial
+	*
+	* @return void
+	*/
+	void renderInstanced(Vec3f, Light, Mat44f, std::size_t, GLuint[]);
 };
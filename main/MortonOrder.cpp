@@ -0,0 +1,97 @@
+#include "MortonOrder.hpp"
+
+#include <algorithm>
+
+#include "JobSystem.hpp"
+
+namespace {
+    // Spreads the low 10 bits of value so that there are two zero bits between each of them
+    uint32_t spreadBits(uint32_t value)
+    {
+        value &= 0x3FF;
+        value = (value | (value << 16)) & 0x030000FF;
+        value = (value | (value << 8)) & 0x0300F00F;
+        value = (value | (value << 4)) & 0x030C30C3;
+        value = (value | (value << 2)) & 0x09249249;
+        return value;
+    }
+
+    // Runs work(chunk) for chunk = 0..chunks-1 as jobs
+    template<class Work>
+    void runOnChunks(std::size_t chunks, Work const& work)
+    {
+        JobSystem::get().parallelFor(chunks, 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t chunk = begin; chunk < end; chunk++)
+                work(chunk);
+        });
+    }
+}
+
+uint32_t mortonCode(Vec3f position, SimulationBounds const& bounds)
+{
+    Vec3f size = bounds.size();
+    uint32_t cell[3];
+    for (int axis = 0; axis < 3; axis++) {
+        float t = (position[axis] - bounds.min[axis]) / size[axis];
+        cell[axis] = (uint32_t)(clamp(t, 0.f, 1.f) * 1023.f);
+    }
+    return spreadBits(cell[0]) | (spreadBits(cell[1]) << 1) | (spreadBits(cell[2]) << 2);
+}
+
+std::vector<uint32_t> const& MortonOrder::sort(std::vector<Boid> const& boids, SimulationBounds const& bounds)
+{
+    std::size_t count = boids.size();
+    std::size_t chunks = std::max<std::size_t>(1, std::min(JobSystem::get().threadCount(), count / MIN_ITEMS_PER_CHUNK));
+    std::size_t chunkSize = (count + chunks - 1) / chunks;
+
+    this->keys.resize(count);
+    this->keysScratch.resize(count);
+    this->order.resize(count);
+    this->orderScratch.resize(count);
+    this->histograms.resize(chunks * BUCKETS);
+
+    runOnChunks(chunks, [&](std::size_t t) {
+        std::size_t end = std::min(count, (t + 1) * chunkSize);
+        for (std::size_t i = t * chunkSize; i < end; i++) {
+            this->keys[i] = mortonCode(boids[i].currentPosition, bounds);
+            this->order[i] = (uint32_t)i;
+        }
+    });
+
+    for (int pass = 0; pass < PASSES; pass++) {
+        int shift = pass * RADIX_BITS;
+
+        // Every job counts the digits of its chunk...
+        runOnChunks(chunks, [&](std::size_t t) {
+            uint32_t* histogram = &this->histograms[t * BUCKETS];
+            std::fill(histogram, histogram + BUCKETS, 0);
+            std::size_t end = std::min(count, (t + 1) * chunkSize);
+            for (std::size_t i = t * chunkSize; i < end; i++)
+                histogram[(this->keys[i] >> shift) & (BUCKETS - 1)]++;
+        });
+
+        // ...the counts become where each chunk writes each digit, keeping the sort stable...
+        uint32_t offset = 0;
+        for (int bucket = 0; bucket < BUCKETS; bucket++) {
+            for (std::size_t t = 0; t < chunks; t++) {
+                uint32_t n = this->histograms[t * BUCKETS + bucket];
+                this->histograms[t * BUCKETS + bucket] = offset;
+                offset += n;
+            }
+        }
+
+        // ...and every job scatters its chunk
+        runOnChunks(chunks, [&](std::size_t t) {
+            uint32_t* position = &this->histograms[t * BUCKETS];
+            std::size_t end = std::min(count, (t + 1) * chunkSize);
+            for (std::size_t i = t * chunkSize; i < end; i++) {
+                uint32_t destination = position[(this->keys[i] >> shift) & (BUCKETS - 1)]++;
+                this->keysScratch[destination] = this->keys[i];
+                this->orderScratch[destination] = this->order[i];
+            }
+        });
+        this->keys.swap(this->keysScratch);
+        this->order.swap(this->orderScratch);
+    }
+    return this->order;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Boid.hpp"
+#include "SimulationBounds.hpp"
+
+/**
+* @brief Interleaves the bits of a position quantised to 10 bits per axis inside the bounds
+* into a 30-bit Morton (Z-order) code: positions close in space get close codes.
+*
+* @param position - The position to encode, clamped to the bounds.
+* @param bounds - The volume mapped onto the 1024^3 lattice.
+*
+* @return uint32_t The Morton code.
+*/
+uint32_t mortonCode(Vec3f, SimulationBounds const&);
+
+/**
+* @brief Computes the order that sorts the boids by the Morton code of their position, with
+* a least-significant-digit radix sort split in chunks run on the JobSystem. The buffers are kept
+* between sorts so that re-sorting does not allocate.
+*/
+class MortonOrder {
+private:
+	static constexpr int RADIX_BITS = 10;
+	static constexpr int BUCKETS = 1 << RADIX_BITS;
+	static constexpr int PASSES = 3;	// 30-bit codes
+	static constexpr std::size_t MIN_ITEMS_PER_CHUNK = 16384;
+
+	std::vector<uint32_t> keys, keysScratch;
+	std::vector<uint32_t> order, orderScratch;
+	std::vector<uint32_t> histograms;	// BUCKETS counters per chunk
+
+public:
+	/**
+	* @brief Sorts the boids by Morton code.
+	*
+	* @param boids - The boids to sort.
+	* @param bounds - The simulation space.
+	*
+	* @return std::vector<uint32_t> const& For every new position, the index of the boid that goes there.
+	* Valid until the next call.
+	*/
+	std::vector<uint32_t> const& sort(std::vector<Boid> const&, SimulationBounds const&);
+};
@@ -0,0 +1,183 @@
+#include "Profiler.hpp"
+
+#include "../third_party/imgui/imgui.h"
+
+#include <cstdio>
+
+namespace {
+    // Small sequential id per thread, used as the "tid" of the Chrome trace
+    std::atomic<uint32_t> nextThreadId{ 0 };
+    thread_local uint32_t threadId = nextThreadId.fetch_add(1);
+
+    const char* STAGE_NAMES[] = {
+        "Neighbour search",
+        "Rules",
+        "Update direction",
+        "Obstacle avoidance",
+        "Morton reorder",
+        "Terrain/obstacle render",
+        "Boid render",
+        "ImGui"
+    };
+    static_assert(sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0]) == (std::size_t)ProfileStage::Count,
+        "Every profiled stage needs a name");
+}
+
+Profiler::Profiler()
+{
+    this->origin = std::chrono::steady_clock::now();
+    this->ring = new Slot[RING_SIZE];
+}
+
+Profiler::~Profiler()
+{
+    delete[] this->ring;
+}
+
+Profiler& Profiler::get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+const char* Profiler::stageName(ProfileStage stage)
+{
+    return STAGE_NAMES[(std::size_t)stage];
+}
+
+void Profiler::record(ProfileStage stage, int64_t start, int64_t end)
+{
+    // Claim a position, write the sample and publish it with the position + 1. The fence
+    // orders the reset of the sequence before the fields, for a reader checking it again
+    uint64_t position = this->head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = this->ring[position & (RING_SIZE - 1)];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.stage.store((uint32_t)stage, std::memory_order_relaxed);
+    slot.threadId.store(threadId, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.sequence.store(position + 1, std::memory_order_release);
+}
+
+void Profiler::endFrame()
+{
+    int64_t frameEnd = now();
+    std::vector<ProfileSample>& trace = this->traceFrames[this->frameIndex % TRACE_FRAMES];
+    trace.clear();
+
+    float totals[STAGE_COUNT] = {};
+    uint64_t published = this->head.load(std::memory_order_acquire);
+
+    // If the writers lapped the reader, the oldest samples are lost
+    if (published - this->tail > RING_SIZE)
+        this->tail = published - RING_SIZE;
+
+    while (this->tail < published) {
+        Slot& slot = this->ring[this->tail & (RING_SIZE - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != this->tail + 1)
+            break; // not published yet, picked up next frame
+        ProfileSample sample{
+            (ProfileStage)slot.stage.load(std::memory_order_relaxed),
+            slot.threadId.load(std::memory_order_relaxed),
+            slot.start.load(std::memory_order_relaxed),
+            slot.end.load(std::memory_order_relaxed)
+        };
+        // Orders the reads of the fields before the second check: an unchanged sequence means no writer got in between
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == this->tail + 1) {
+            totals[(std::size_t)sample.stage] += (sample.end - sample.start) / 1e6f;
+            trace.push_back(sample);
+        }
+        this->tail++;
+    }
+
+    // Aggregate the frame into the per-stage breakdown and the history
+    std::size_t column = this->frameIndex % HISTORY_SIZE;
+    for (std::size_t i = 0; i < STAGE_COUNT; i++) {
+        this->lastFrame[i] = totals[i];
+        this->history[i][column] = totals[i];
+    }
+    this->lastFrameTime = (frameEnd - this->frameStart) / 1e6f;
+    this->history[STAGE_COUNT][column] = this->lastFrameTime;
+
+    this->traceFrameStart[this->frameIndex % TRACE_FRAMES] = this->frameStart;
+    this->traceFrameEnd[this->frameIndex % TRACE_FRAMES] = frameEnd;
+
+    this->frameStart = frameEnd;
+    this->frameIndex++;
+}
+
+bool Profiler::exportChromeTrace(const char* path) const
+{
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Error: unable to open trace file %s\n", path);
+        return false;
+    }
+
+    // Timestamps in the Chrome trace format are in microseconds
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"Main thread\"}}");
+    std::size_t frames = this->frameIndex < TRACE_FRAMES ? this->frameIndex : TRACE_FRAMES;
+    for (std::size_t f = frames; f > 0; f--) {
+        std::size_t index = (this->frameIndex - f) % TRACE_FRAMES;
+        fprintf(file, ",\n{\"name\":\"Frame\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+            this->traceFrameStart[index] / 1e3, (this->traceFrameEnd[index] - this->traceFrameStart[index]) / 1e3);
+        for (ProfileSample const& sample : this->traceFrames[index]) {
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"boids\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                stageName(sample.stage), sample.threadId, sample.start / 1e3, (sample.end - sample.start) / 1e3);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
+
+void Profiler::drawGui()
+{
+    // Per-stage breakdown of the last frame
+    ImGui::Text("Last frame %.3f ms", this->lastFrameTime);
+    ImGui::Columns(2, "profiler");
+    ImGui::SetColumnWidth(0, 250);
+    for (std::size_t i = 0; i < STAGE_COUNT; i++) {
+        ImGui::Text("%s", STAGE_NAMES[i]);
+        ImGui::NextColumn();
+        char overlay[32];
+        snprintf(overlay, sizeof(overlay), "%.3f ms", this->lastFrame[i]);
+        float fraction = this->lastFrameTime > 0.f ? this->lastFrame[i] / this->lastFrameTime : 0.f;
+        ImGui::ProgressBar(fraction, ImVec2(-1.f, 0.f), overlay);
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+
+    // Histogram of the selected stage over the last HISTORY_SIZE frames
+    const char* histogramItems[STAGE_COUNT + 1];
+    for (std::size_t i = 0; i < STAGE_COUNT; i++)
+        histogramItems[i] = STAGE_NAMES[i];
+    histogramItems[STAGE_COUNT] = "Whole frame";
+    ImGui::Combo("Histogram", &this->historyStage, histogramItems, (int)STAGE_COUNT + 1);
+
+    float const* values = this->history[this->historyStage];
+    float average = 0.f, maximum = 0.f;
+    for (std::size_t i = 0; i < HISTORY_SIZE; i++) {
+        average += values[i];
+        if (values[i] > maximum) maximum = values[i];
+    }
+    average /= HISTORY_SIZE;
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "avg %.3f ms, max %.3f ms", average, maximum);
+    ImGui::PlotHistogram("##history", values, (int)HISTORY_SIZE, (int)((this->frameIndex) % HISTORY_SIZE),
+        overlay, 0.f, maximum * 1.1f, ImVec2(-1.f, 80.f));
+
+    if (ImGui::Button("Export Chrome trace")) {
+        if (exportChromeTrace("boids_trace.json"))
+            snprintf(this->exportStatus, sizeof(this->exportStatus), "Last %zu frames written to boids_trace.json", TRACE_FRAMES);
+        else
+            snprintf(this->exportStatus, sizeof(this->exportStatus), "Unable to write boids_trace.json");
+    }
+    if (this->exportStatus[0] != '\0') {
+        ImGui::SameLine();
+        ImGui::Text("%s", this->exportStatus);
+    }
+}
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+* @brief The stages of a frame timed by the profiler.
+*/
+enum class ProfileStage : uint32_t {
+	NeighbourSearch,
+	Rules,
+	UpdateDirection,
+	ObstacleAvoidance,
+	Reorder,
+	SceneRender,
+	BoidRender,
+	GUI,
+	Count
+};
+
+/**
+* @brief A single timed scope, with timestamps in nanoseconds since the profiler was created.
+*/
+struct ProfileSample {
+	ProfileStage stage;
+	uint32_t threadId;
+	int64_t start;
+	int64_t end;
+};
+
+/**
+* @brief Collects timed scopes from any thread into a lock-free ring buffer and
+* aggregates them once per frame into a per-stage breakdown and history.
+*/
+class Profiler {
+public:
+	static constexpr std::size_t HISTORY_SIZE = 240;
+	static constexpr std::size_t TRACE_FRAMES = 4;
+
+private:
+	// Scopes are per job, not per boid (see ProfileAccumulator): a tick records a few samples
+	// per stage, species and parallel range, at most 4 ranges per thread, far below this
+	static constexpr std::size_t RING_SIZE = 1 << 16;
+	static constexpr std::size_t STAGE_COUNT = (std::size_t)ProfileStage::Count;
+
+	// A ring buffer slot; sequence is the ring position + 1 once the sample is published.
+	// The fields are relaxed atomics so that a reader racing a writer that laps it reads
+	// a torn sample, which the sequence check then discards, rather than a data race
+	struct Slot {
+		std::atomic<uint64_t> sequence{ 0 };
+		std::atomic<uint32_t> stage{ 0 };
+		std::atomic<uint32_t> threadId{ 0 };
+		std::atomic<int64_t> start{ 0 };
+		std::atomic<int64_t> end{ 0 };
+	};
+
+	std::chrono::steady_clock::time_point origin;
+
+	Slot* ring;
+	std::atomic<uint64_t> head{ 0 };
+	uint64_t tail = 0;
+
+	int64_t frameStart = 0;
+	uint64_t frameIndex = 0;
+
+	// Per-stage totals of the last frame and their history (in ms)
+	float lastFrame[STAGE_COUNT] = {};
+	float lastFrameTime = 0.f;
+	float history[STAGE_COUNT + 1][HISTORY_SIZE] = {};
+	int historyStage = (int)STAGE_COUNT; // stage shown in the histogram, STAGE_COUNT is the whole frame
+
+	// Raw samples of the last TRACE_FRAMES frames, kept for the Chrome trace export
+	std::vector<ProfileSample> traceFrames[TRACE_FRAMES];
+	int64_t traceFrameStart[TRACE_FRAMES] = {};
+	int64_t traceFrameEnd[TRACE_FRAMES] = {};
+	char exportStatus[128] = "";
+
+	Profiler();
+	~Profiler();
+
+public:
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	/**
+	* @brief Returns the profiler shared by the whole application.
+	*/
+	static Profiler& get();
+
+	/**
+	* @brief Returns the name of a profiled stage.
+	*/
+	static const char* stageName(ProfileStage);
+
+	/**
+	* @brief Current time in nanoseconds since the profiler was created.
+	*/
+	int64_t now() const {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+	}
+
+	/**
+	* @brief Pushes a timed scope into the ring buffer. Safe to call from any thread.
+	*
+	* @param stage - The stage the scope belongs to.
+	* @param start - Start of the scope (from now()).
+	* @param end - End of the scope (from now()).
+	*
+	* @return void
+	*/
+	void record(ProfileStage, int64_t, int64_t);
+
+	/**
+	* @brief Drains the ring buffer and aggregates the samples of the frame that just ended.
+	* Must be called once per frame from the main thread.
+	*
+	* @return void
+	*/
+	void endFrame();
+
+	/**
+	* @brief Time spent in a stage during the last frame, in milliseconds.
+	*/
+	float stageTime(ProfileStage stage) const {
+		return lastFrame[(std::size_t)stage];
+	}
+
+	/**
+	* @brief Duration of the last frame, in milliseconds.
+	*/
+	float frameTime() const {
+		return lastFrameTime;
+	}
+
+	/**
+	* @brief Writes the samples of the last TRACE_FRAMES frames as a Chrome trace
+	* (chrome://tracing or ui.perfetto.dev).
+	*
+	* @param path - The path of the JSON file to write.
+	*
+	* @return true if the file was written.
+	*/
+	bool exportChromeTrace(const char*) const;
+
+	/**
+	* @brief Draws the per-stage breakdown and histogram in the current ImGui window.
+	*
+	* @return void
+	*/
+	void drawGui();
+};
+
+/**
+* @brief Times the enclosing scope and records it in the profiler when destroyed.
+*/
+class ProfileScope {
+private:
+	ProfileStage stage;
+	int64_t start;
+public:
+	ProfileScope(ProfileStage stage) {
+		this->stage = stage;
+		this->start = Profiler::get().now();
+	}
+
+	~ProfileScope() {
+		Profiler& profiler = Profiler::get();
+		profiler.record(this->stage, this->start, profiler.now());
+	}
+};
+
+/**
+* @brief Sums the time of scopes of several stages interleaved in a loop, e.g. per boid, and records
+* one sample per stage when destroyed, so that a job records a few samples however many items it has.
+* The samples are laid end to end from the creation of the accumulator: their durations are exact,
+* their positions in the trace only approximate.
+*/
+#ifdef BOIDS_DISABLE_PROFILING
+class ProfileAccumulator {
+public:
+	void add(ProfileStage, int64_t) {}
+};
+#else
+class ProfileAccumulator {
+private:
+	int64_t start;
+	int64_t totals[(std::size_t)ProfileStage::Count] = {};
+public:
+	ProfileAccumulator() {
+		this->start = Profiler::get().now();
+	}
+
+	~ProfileAccumulator() {
+		Profiler& profiler = Profiler::get();
+		int64_t at = this->start;
+		for (std::size_t i = 0; i < (std::size_t)ProfileStage::Count; i++) {
+			if (this->totals[i] > 0) {
+				profiler.record((ProfileStage)i, at, at + this->totals[i]);
+				at += this->totals[i];
+			}
+		}
+	}
+
+	/**
+	* @brief Adds the duration of a scope to its stage.
+	*
+	* @param stage - The stage the scope belongs to.
+	* @param duration - The duration of the scope in nanoseconds.
+	*
+	* @return void
+	*/
+	void add(ProfileStage stage, int64_t duration) {
+		this->totals[(std::size_t)stage] += duration;
+	}
+};
+#endif
+
+/**
+* @brief Times the enclosing scope and adds it to an accumulator when destroyed.
+*/
+class AccumulatedProfileScope {
+private:
+	ProfileAccumulator& accumulator;
+	ProfileStage stage;
+	int64_t start;
+public:
+	AccumulatedProfileScope(ProfileAccumulator& accumulator, ProfileStage stage) : accumulator(accumulator) {
+		this->stage = stage;
+		this->start = Profiler::get().now();
+	}
+
+	~AccumulatedProfileScope() {
+		this->accumulator.add(this->stage, Profiler::get().now() - this->start);
+	}
+};
+
+// Define BOIDS_DISABLE_PROFILING to compile the scoped timers out entirely
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#ifdef BOIDS_DISABLE_PROFILING
+#define PROFILE_SCOPE(stage)
+#define PROFILE_ACCUMULATE(accumulator, stage)
+#else
+#define PROFILE_SCOPE(stage) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(stage)
+#define PROFILE_ACCUMULATE(accumulator, stage) AccumulatedProfileScope PROFILE_CONCAT(profileScope, __LINE__)(accumulator, stage)
+#endif
@@ -0,0 +1,359 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Arena.hpp"
+#include "Boid.hpp"
+#include "BoidPool.hpp"
+#include "Flock.hpp"
+#include "JobSystem.hpp"
+#include "Obstacle.hpp"
+#include "Profiler.hpp"
+#include "SimulationBounds.hpp"
+#include "SpatialGrid.hpp"
+#include "VerletList.hpp"
+
+/**
+* @brief Bits of a rule mask, one per rule policy.
+*/
+enum RuleBit : uint32_t {
+	RULE_COHESION = 1 << 0,
+	RULE_ALIGNMENT = 1 << 1,
+	RULE_SEPARATION = 1 << 2,
+	RULE_TARGET = 1 << 3,
+	RULE_EDGE_AVOIDANCE = 1 << 4,
+	RULE_OBSTACLE_AVOIDANCE = 1 << 5,
+	RULE_FLEE = 1 << 6,
+	RULE_ALL = (1 << 7) - 1
+};
+
+/**
+* @brief What the rules of a tick can read, the neighbours are refilled for every boid
+* and every species it interacts with. Each job owns one, so the lists keep their capacity from boid to boid.
+*/
+struct RuleContext {
+	FlockSettings const& settings;
+	SpeciesSettings const& species;	// parameters of the species being updated
+	SimulationBounds const& bounds;
+	std::vector<Obstacle*> const& obstacles;
+	Flock& flock;	// the spatial grids of the other species
+	float dt;
+	ArenaVector<Boid*> neighbours;
+	ArenaVector<NeighbourSample> samples;	// instead of the neighbours in approximate mode
+	ArenaVector<std::pair<float, uint32_t>> nearest;	// scratch heap of the topological search
+};
+
+// Rule policies. Each one has:
+//	bit - its bit in the rule mask,
+//	needsNeighbours - whether the neighbour search has to run for it,
+//	avoidance - false if it steers the boid (summed with its direction and normalized),
+//		true if it pushes the boid away from something (added after the normalization),
+//	apply(boid, context) - its contribution to the boid's target direction.
+
+struct CohesionRule {
+	static constexpr uint32_t bit = RULE_COHESION;
+	static constexpr bool needsNeighbours = true;
+	static constexpr bool avoidance = false;
+	static Vec3f apply(Boid& boid, RuleContext const& context) {
+		if (context.settings.approximate)
+			return boid.applyCohesion(context.samples, context.species.cohesion);
+		return boid.applyCohesion(context.neighbours, context.species.cohesion, context.bounds);
+	}
+};
+
+struct AlignmentRule {
+	static constexpr uint32_t bit = RULE_ALIGNMENT;
+	static constexpr bool needsNeighbours = true;
+	static constexpr bool avoidance = false;
+	static Vec3f apply(Boid& boid, RuleContext const& context) {
+		if (context.settings.approximate)
+			return boid.applyAlignment(context.samples, context.species.alignment);
+		return boid.applyAlignment(context.neighbours, context.species.alignment);
+	}
+};
+
+struct SeparationRule {
+	static constexpr uint32_t bit = RULE_SEPARATION;
+	static constexpr bool needsNeighbours = true;
+	static constexpr bool avoidance = false;
+	static Vec3f apply(Boid& boid, RuleContext const& context) {
+		if (context.settings.approximate)
+			return boid.applySeparation(context.samples, context.species.separation, context.species.visionRange);
+		return boid.applySeparation(context.neighbours, context.species.separation, context.species.visionRange, context.bounds);
+	}
+};
+
+// User guidance: a fixed direction, or the direction to the target point
+struct TargetRule {
+	static constexpr uint32_t bit = RULE_TARGET;
+	static constexpr bool needsNeighbours = false;
+	static constexpr bool avoidance = false;
+	static Vec3f apply(Boid& boid, RuleContext const& context) {
+		if (context.settings.followTargetPoint)
+			return normalize(context.bounds.displacement(boid.currentPosition, context.settings.targetPoint));
+		return context.settings.targetDirection;
+	}
+};
+
+struct EdgeAvoidanceRule {
+	static constexpr uint32_t bit = RULE_EDGE_AVOIDANCE;
+	static constexpr bool needsNeighbours = false;
+	static constexpr bool avoidance = true;
+	static Vec3f apply(Boid& boid, RuleContext const& context) {
+		return boid.avoidEdges(context.bounds, context.species.edgeAvoidance);
+	}
+};
+
+struct ObstacleAvoidanceRule {
+	static constexpr uint32_t bit = RULE_OBSTACLE_AVOIDANCE;
+	static constexpr bool needsNeighbours = false;
+	static constexpr bool avoidance = true;
+	static Vec3f apply(Boid& boid, RuleContext const& context) {
+		return boid.avoidObstacles(context.obstacles, context.species.obstacleAvoidance);
+	}
+};
+
+// Steers away from the predators within the fear radius, found through the grids of the predator species
+struct FleeRule {
+	static constexpr uint32_t bit = RULE_FLEE;
+	static constexpr bool needsNeighbours = false;
+	static constexpr bool avoidance = true;
+	static Vec3f apply(Boid& boid, RuleContext const& context) {
+		Vec3f flee = { 0.f, 0.f, 0.f };
+		for (uint32_t species = 0; species < MAX_SPECIES; species++) {
+			SpeciesSettings const& predator = context.settings.species[species];
+			std::vector<Boid> const& predators = context.flock.pool(species).all();
+			if (!predator.predator || predators.empty())
+				continue;
+			// The predators updated before this species have moved since their grid was built
+			flee += boid.fleePredators(context.flock.grid(species), predators, context.bounds,
+				context.species.fearRadius, context.species.flee, context.dt * predator.speed);
+		}
+		return flee;
+	}
+};
+
+/**
+* @brief Whether a species flees from the boids of a predator species.
+*
+* @param species - The parameters of the rules of the species.
+* @param settings - The parameters of all the species.
+*
+* @return bool True if the species is prey to at least one predator species.
+*/
+inline bool fleesPredators(SpeciesSettings const& species, FlockSettings const& settings) {
+	if (species.predator || species.flee == 0.f || species.fearRadius <= 0.f)
+		return false;
+	for (SpeciesSettings const& other : settings.species) {
+		if (other.predator)
+			return true;
+	}
+	return false;
+}
+
+/**
+* @brief The mask of the rules that have an effect with the given settings: zero-strength rules,
+* guidance without a target and edge avoidance in periodic bounds are left out.
+*
+* @param species - The parameters of the rules of the species.
+* @param settings - The guidance shared by all the species.
+* @param bounds - The simulation space.
+*
+* @return uint32_t The RuleBit mask of the rules to run.
+*/
+inline uint32_t activeRules(SpeciesSettings const& species, FlockSettings const& settings, SimulationBounds const& bounds) {
+	uint32_t mask = 0;
+	if (species.cohesion != 0.f) mask |= RULE_COHESION;
+	if (species.alignment != 0.f) mask |= RULE_ALIGNMENT;
+	if (species.separation != 0.f) mask |= RULE_SEPARATION;
+	if (settings.followTargetPoint || settings.targetDirection.x != 0.f || settings.targetDirection.y != 0.f || settings.targetDirection.z != 0.f)
+		mask |= RULE_TARGET;
+	if (species.edgeAvoidance != 0.f && !bounds.periodic) mask |= RULE_EDGE_AVOIDANCE;
+	if (species.obstacleAvoidance != 0.f) mask |= RULE_OBSTACLE_AVOIDANCE;
+	if (fleesPredators(species, settings)) mask |= RULE_FLEE;
+	return mask;
+}
+
+/**
+* @brief A simulation tick specialised for a set of rules. The loop over the boids is generated
+* for exactly these rules: the others, and the neighbour search if none of them needs it,
+* are not compiled in.
+*/
+template<class... Rules>
+struct RulePipeline {
+	static constexpr bool needsNeighbours = (false || ... || Rules::needsNeighbours);
+	static constexpr bool hasAvoidance = (false || ... || Rules::avoidance);
+	static constexpr bool hasOwnSteering = (false || ... || (!Rules::avoidance && !Rules::needsNeighbours));
+	static constexpr uint32_t neighbourRules = (0u | ... | (Rules::needsNeighbours ? Rules::bit : 0u));
+
+	// Boids per job of the parallel loops
+	static constexpr std::size_t PARALLEL_GRAIN = 64;
+
+	template<bool Avoidance, bool Neighbours, class Rule>
+	static void accumulate(Vec3f& sum, Boid& boid, RuleContext const& context) {
+		if constexpr (Rule::avoidance == Avoidance && Rule::needsNeighbours == Neighbours)
+			sum += Rule::apply(boid, context);
+	}
+
+	// Sum of the rules that avoid or steer, and that do or do not use the neighbours
+	template<bool Avoidance, bool Neighbours>
+	static Vec3f sum(Boid& boid, RuleContext const& context) {
+		Vec3f result = { 0.f, 0.f, 0.f };
+		(accumulate<Avoidance, Neighbours, Rules>(result, boid, context), ...);
+		return result;
+	}
+
+	/**
+	* @brief Sets the target direction of one boid from the rules.
+	*
+	* @param flock - The flock, with the grids of the species searched this tick already built.
+	* @param observer - The species of the boid.
+	* @param i - The index of the boid in its species.
+	* @param context - The settings, bounds and obstacles of the tick, with the neighbour lists of the calling thread.
+	* @param useVerlet - Whether the Verlet lists of the species are valid for this tick.
+	* @param profile - The stage times of the calling job, recorded once per job rather than per boid.
+	*
+	* @return void
+	*/
+	static void steer(Flock& flock, uint32_t observer, std::size_t i, RuleContext& context, [[maybe_unused]] bool useVerlet,
+		[[maybe_unused]] ProfileAccumulator& profile) {
+		Flock::Species& self = flock.species[observer];
+		std::vector<Boid>& boids = self.boids.all();
+		[[maybe_unused]] FlockSettings const& settings = context.settings;
+		[[maybe_unused]] SpeciesSettings const& params = context.species;
+		Boid& boid = boids[i];
+		Vec3f steering = { 0.f, 0.f, 0.f };
+		Vec3f avoid = { 0.f, 0.f, 0.f };
+		if constexpr (needsNeighbours) {
+			for (uint32_t other = 0; other < MAX_SPECIES; other++) {
+				float weight = settings.interaction[observer][other];
+				Flock::Species& species = flock.species[other];
+				if (weight == 0.f || species.boids.size() == 0)
+					continue;
+				// The species updated earlier in the tick have moved since their grid was built,
+				// by at most one tick of their own speed
+				float margin = context.dt * settings.species[other].speed;
+				{
+					PROFILE_ACCUMULATE(profile, ProfileStage::NeighbourSearch);
+					context.neighbours.clear();
+					context.samples.clear();
+					if (settings.approximate) {
+						boid.sampleNeighbours(species.grid, species.boids.all(), context.bounds,
+							params.visionRange, params.visionAngle, margin, settings.openingAngle, context.samples);
+					}
+					else if (settings.topological) {
+						boid.findNearestNeighbours(species.grid, species.boids.all(), context.bounds, params.visionRange, params.visionAngle,
+							margin, (std::size_t)settings.topologicalNeighbours, context.nearest, context.neighbours);
+					}
+					else if (other == observer && useVerlet) {
+						boid.filterNeighbours(self.verlet.candidatesOf(i), self.verlet.candidateCount(i), boids,
+							context.bounds, params.visionRange, params.visionAngle, context.neighbours);
+					}
+					else {
+						boid.findNeighbours(species.grid, species.boids.all(), context.bounds,
+							params.visionRange, params.visionAngle, margin, context.neighbours);
+					}
+				}
+				PROFILE_ACCUMULATE(profile, ProfileStage::Rules);
+				steering += weight * sum<false, true>(boid, context);
+			}
+		}
+		if constexpr (hasOwnSteering) {
+			PROFILE_ACCUMULATE(profile, ProfileStage::Rules);
+			steering += sum<false, false>(boid, context);
+		}
+		if constexpr (hasAvoidance) {
+			PROFILE_ACCUMULATE(profile, ProfileStage::ObstacleAvoidance);
+			avoid = sum<true, false>(boid, context);
+		}
+		boid.setTargetDirection(normalize(boid.currentDirection + steering) + avoid);
+	}
+
+	/**
+	* @brief Advances every boid of a species by one tick. The neighbour rules run once per
+	* species it interacts with, on the neighbours of that species only, and are weighed by
+	* the interaction matrix. All the boids of the species are steered first, in parallel
+	* on the JobSystem, reading the species as it was at the start of the tick and writing
+	* only their own target direction; then they all move, in parallel too.
+	*
+	* @param flock - The flock, with the grids of the species searched this tick already built.
+	* @param observer - The species to update.
+	* @param context - The settings, bounds and obstacles of the tick.
+	* @param dt - The time since the last tick, in seconds.
+	*
+	* @return void
+	*/
+	static void run(Flock& flock, uint32_t observer, RuleContext& context, float dt) {
+		Flock::Species& self = flock.species[observer];
+		std::vector<Boid>& boids = self.boids.all();
+		[[maybe_unused]] FlockSettings const& settings = context.settings;
+		SpeciesSettings const& params = context.species;
+		float movementSpeed = dt * params.speed;
+		float turnSharpness = movementSpeed * 0.2f;
+
+		bool useVerlet = false;
+		if constexpr (needsNeighbours) {
+			PROFILE_SCOPE(ProfileStage::NeighbourSearch);
+			if (settings.verletLists && !settings.approximate && !settings.topological && settings.interaction[observer][observer] != 0.f) {
+				useVerlet = self.verlet.prepare(boids, self.boids.getRevision(), context.bounds,
+					params.visionRange, settings.verletSkin, movementSpeed);
+			}
+			else {
+				self.verlet.invalidate();
+			}
+		}
+
+		JobSystem& jobs = JobSystem::get();
+		jobs.parallelFor(boids.size(), PARALLEL_GRAIN, [&](std::size_t begin, std::size_t end) {
+			// Every job fills its own neighbour lists, reused for all its boids, and sums its own stage times
+			RuleContext local{ context.settings, context.species, context.bounds, context.obstacles, context.flock, context.dt, {}, {}, {} };
+			ProfileAccumulator profile;
+			for (std::size_t i = begin; i < end; i++)
+				steer(flock, observer, i, local, useVerlet, profile);
+		});
+		jobs.parallelFor(boids.size(), PARALLEL_GRAIN, [&](std::size_t begin, std::size_t end) {
+			PROFILE_SCOPE(ProfileStage::UpdateDirection);
+			for (std::size_t i = begin; i < end; i++)
+				boids[i].updateDirection(movementSpeed, turnSharpness, context.bounds);
+		});
+	}
+};
+
+// Every rule policy, in the order their contributions are summed
+using AllRules = RulePipeline<CohesionRule, AlignmentRule, SeparationRule, TargetRule, EdgeAvoidanceRule, ObstacleAvoidanceRule, FleeRule>;
+
+// Keeps the rules of Remaining whose bit is in Mask, appending them to Kept
+template<uint32_t Mask, class Kept, class Remaining>
+struct SelectRules;
+
+template<uint32_t Mask, class... Kept>
+struct SelectRules<Mask, RulePipeline<Kept...>, RulePipeline<>> {
+	using type = RulePipeline<Kept...>;
+};
+
+template<uint32_t Mask, class... Kept, class First, class... Rest>
+struct SelectRules<Mask, RulePipeline<Kept...>, RulePipeline<First, Rest...>> {
+	using type = typename SelectRules<Mask,
+		std::conditional_t<(Mask & First::bit) != 0, RulePipeline<Kept..., First>, RulePipeline<Kept...>>,
+		RulePipeline<Rest...>>::type;
+};
+
+template<uint32_t Mask>
+using PipelineFor = typename SelectRules<Mask, RulePipeline<>, AllRules>::type;
+
+using PipelineFunction = void (*)(Flock&, uint32_t, RuleContext&, float);
+
+template<std::size_t... Masks>
+constexpr std::array<PipelineFunction, sizeof...(Masks)> makePipelineTable(std::index_sequence<Masks...>) {
+	return { &PipelineFor<(uint32_t)Masks>::run... };
+}
+
+/**
+* @brief Runtime dispatcher: the specialised tick of every rule mask, indexed by the mask.
+*/
+inline constexpr std::array<PipelineFunction, RULE_ALL + 1> RULE_PIPELINES =
+	makePipelineTable(std::make_index_sequence<RULE_ALL + 1>{});
@@ -0,0 +1,200 @@
+#include "SceneBatch.hpp"
+#include "GpuProfiler.hpp"
+
+#include <cstdio>
+
+#define MATERIAL_INDEX 2		// per draw, in .vert
+#define DRAW_TRANSFORMS 3		// 3 locations, one per matrix row
+#define DRAW_NORMALS 6			// 3 locations, one per normal matrix row
+
+namespace {
+    bool sameVector(Vec3f a, Vec3f b)
+    {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+
+    bool sameMaterial(Material const& a, Material const& b)
+    {
+        return sameVector(a.ambient, b.ambient) && sameVector(a.diffuse, b.diffuse) && sameVector(a.specular, b.specular)
+            && sameVector(a.emission, b.emission) && a.shininess == b.shininess && a.alpha == b.alpha;
+    }
+}
+
+SceneBatch::SceneBatch(std::size_t passes)
+    : passCommands(passes), passData(passes), passFirst(passes, 0), passCount(passes, 0)
+{
+}
+
+void SceneBatch::cleanup()
+{
+    glDeleteBuffers(1, &this->vertexBuffer);
+    glDeleteBuffers(1, &this->commandBuffer);
+    glDeleteBuffers(1, &this->drawBuffer);
+    glDeleteVertexArrays(1, &this->VAO);
+    this->vertexBuffer = this->commandBuffer = this->drawBuffer = this->VAO = 0;
+}
+
+void SceneBatch::clear()
+{
+    this->vertices.clear();
+    this->materials.clear();
+    this->meshes.clear();
+    for (std::size_t pass = 0; pass < this->passCommands.size(); pass++) {
+        this->passCommands[pass].clear();
+        this->passData[pass].clear();
+    }
+}
+
+std::size_t SceneBatch::meshOf(Model const& model)
+{
+    for (std::size_t i = 0; i < this->meshes.size(); i++) {
+        if (this->meshes[i].model == &model)
+            return i;
+    }
+
+    Mesh mesh{ &model, (GLuint)this->vertices.size(), {} };
+    for (Vertex const& vertex : model.vertices)
+        this->vertices.push_back(pack_vertex(vertex));
+
+    // Materials used by several meshes are stored once
+    for (Material const& material : model.materials) {
+        std::size_t index = 0;
+        while (index < this->materials.size() && !sameMaterial(this->materials[index], material))
+            index++;
+        if (index == this->materials.size()) {
+            if (index == MAX_MATERIALS) {
+                printf("SceneBatch: more than %zu materials, using the first one\n", MAX_MATERIALS);
+                index = 0;
+            }
+            else {
+                this->materials.push_back(material);
+            }
+        }
+        mesh.materials.push_back((GLuint)index);
+    }
+    this->meshes.push_back(std::move(mesh));
+    return this->meshes.size() - 1;
+}
+
+void SceneBatch::add(std::size_t pass, Model const& model, Mat44f const& model2world)
+{
+    Mesh const& mesh = this->meshes[meshOf(model)];
+
+    DrawData data = {};
+    Mat33f const normalMatrix = mat33(transpose(invert(model2world)));
+    for (std::size_t i = 0; i < 12; i++)
+        data.model2world[i] = model2world.v[i];
+    for (std::size_t row = 0; row < 3; row++) {
+        for (std::size_t column = 0; column < 3; column++)
+            data.normal2world[row * 4 + column] = normalMatrix(row, column);
+    }
+
+    // One draw command per material range of the mesh, see Model::getMaterialEnds
+    std::vector<GLint> const& ends = model.getMaterialEnds();
+    GLint start = 0;
+    for (std::size_t m = 0; m < ends.size(); m++) {
+        if (ends[m] > start) {
+            data.material = (GLint)mesh.materials[m];
+            this->passCommands[pass].push_back(DrawCommand{ (GLuint)(ends[m] - start), 1, mesh.first + (GLuint)start, 0 });
+            this->passData[pass].push_back(data);
+        }
+        start = ends[m];
+    }
+}
+
+void SceneBatch::upload()
+{
+    // The passes follow each other in the command and per-draw buffers,
+    // the base instance of a command is the index of its per-draw data
+    std::vector<DrawCommand> commands;
+    std::vector<DrawData> draws;
+    for (std::size_t pass = 0; pass < this->passCommands.size(); pass++) {
+        this->passFirst[pass] = commands.size();
+        this->passCount[pass] = this->passCommands[pass].size();
+        for (std::size_t i = 0; i < this->passCommands[pass].size(); i++) {
+            DrawCommand command = this->passCommands[pass][i];
+            command.baseInstance = (GLuint)commands.size();
+            commands.push_back(command);
+            draws.push_back(this->passData[pass][i]);
+        }
+    }
+
+    cleanup();
+    if (commands.empty())
+        return;
+
+    glGenVertexArrays(1, &this->VAO);
+    glBindVertexArray(this->VAO);
+
+    glGenBuffers(1, &this->vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, this->vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(PackedVertex), this->vertices.data(), GL_STATIC_DRAW);
+    setup_packed_vertex_attributes();
+
+    glGenBuffers(1, &this->drawBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, this->drawBuffer);
+    glBufferData(GL_ARRAY_BUFFER, draws.size() * sizeof(DrawData), draws.data(), GL_STATIC_DRAW);
+    glVertexAttribIPointer(
+        MATERIAL_INDEX,	// location in .vert
+        1, GL_INT,	// 1 int for the material index
+        sizeof(DrawData),	// one per draw
+        (GLvoid*)offsetof(DrawData, material)
+    );
+    glVertexAttribDivisor(MATERIAL_INDEX, 1);
+    glEnableVertexAttribArray(MATERIAL_INDEX);
+    for (GLuint row = 0; row < 3; row++) {
+        glVertexAttribPointer(
+            DRAW_TRANSFORMS + row,	// location in .vert
+            4, GL_FLOAT, GL_FALSE, // 4 floats per row
+            sizeof(DrawData),	// one matrix per draw
+            (GLvoid*)(offsetof(DrawData, model2world) + row * 4 * sizeof(float))	// offset of the row
+        );
+        glVertexAttribDivisor(DRAW_TRANSFORMS + row, 1);
+        glEnableVertexAttribArray(DRAW_TRANSFORMS + row);
+
+        glVertexAttribPointer(
+            DRAW_NORMALS + row,	// location in .vert
+            3, GL_FLOAT, GL_FALSE, // 3 floats per row, the 4th is unused
+            sizeof(DrawData),	// one matrix per draw
+            (GLvoid*)(offsetof(DrawData, normal2world) + row * 4 * sizeof(float))	// offset of the row
+        );
+        glVertexAttribDivisor(DRAW_NORMALS + row, 1);
+        glEnableVertexAttribArray(DRAW_NORMALS + row);
+    }
+
+    glGenBuffers(1, &this->commandBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawCommand), commands.data(), GL_STATIC_DRAW);
+
+    // Reset state
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void SceneBatch::render(std::size_t pass, Vec3f cameraPosition, Light const& light, Mat44f const& world2projection, GLuint shaderProgram)
+{
+    if (this->passCount[pass] == 0 || this->VAO == 0)
+        return;
+
+    gl_state_change(glUseProgram, shaderProgram);
+    gl_uniform(glUniformMatrix4fv,
+        0,
+        1, GL_TRUE, world2projection.v
+    );
+    upload_shading_uniforms(shaderProgram, cameraPosition, light, this->materials);
+
+    gl_state_change(glBindVertexArray, this->VAO);
+    gl_state_change(glBindBuffer, GL_DRAW_INDIRECT_BUFFER, this->commandBuffer);
+    glMultiDrawArraysIndirect(GL_TRIANGLES, (GLvoid*)(this->passFirst[pass] * sizeof(DrawCommand)),
+        (GLsizei)this->passCount[pass], sizeof(DrawCommand));
+
+    RenderStats& stats = GpuProfiler::get().stats;
+    stats.drawCalls++;
+    for (std::size_t i = 0; i < this->passCount[pass]; i++)
+        stats.vertices += this->passCommands[pass][i].count;
+
+    // Reset state
+    gl_state_change(glBindVertexArray, 0);
+    gl_state_change(glBindBuffer, GL_DRAW_INDIRECT_BUFFER, 0);
+}
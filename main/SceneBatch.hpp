@@ -0,0 +1,130 @@
+#pragma once
+
+#include <glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Model.hpp"
+
+/**
+* @brief The static meshes of the scene drawn with one glMultiDrawArraysIndirect per pass.
+* The vertices of every mesh added are copied once into a shared vertex buffer, and every
+* object placed in the scene becomes one draw command per material of its mesh. The model2world
+* and normal matrices and the material index of every draw command live in a per-draw buffer, read as instanced
+* attributes with the draw command's base instance, so no uniform changes between objects.
+* The draw commands are grouped by pass: the objects drawn with the same GL state, e.g. all
+* the hitboxes, blended.
+*/
+class SceneBatch {
+public:
+	// The materials of all the meshes share the material array of the shader
+	static constexpr std::size_t MAX_MATERIALS = 10;
+
+private:
+	// Same layout as DrawArraysIndirectCommand
+	struct DrawCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint first;
+		GLuint baseInstance;
+	};
+
+	// Per-draw attributes, padded to a multiple of 16 bytes
+	struct DrawData {
+		float model2world[12];	// rows of the affine matrix
+		float normal2world[12];	// rows of the normal matrix, the 4th column is unused
+		GLint material;
+		GLint padding[3];
+	};
+
+	// Where the vertices of an added mesh are in the shared buffer
+	struct Mesh {
+		Model const* model;
+		GLuint first;
+		std::vector<GLuint> materials;	// index in the material array of each material of the model
+	};
+
+	std::vector<PackedVertex> vertices;
+	std::vector<Material> materials;
+	std::vector<Mesh> meshes;
+	std::vector<std::vector<DrawCommand>> passCommands;
+	std::vector<std::vector<DrawData>> passData;
+
+	// First draw command and number of draw commands of each pass in the uploaded buffers
+	std::vector<std::size_t> passFirst;
+	std::vector<std::size_t> passCount;
+
+	GLuint VAO = 0;
+	GLuint vertexBuffer = 0;
+	GLuint commandBuffer = 0;
+	GLuint drawBuffer = 0;
+
+	/**
+	* @brief Returns the mesh of a model, copying its vertices into the shared buffer the first time.
+	*
+	* @param model - The model.
+	*
+	* @return The index of the mesh.
+	*/
+	std::size_t meshOf(Model const&);
+
+	/**
+	* @brief Deletes the GL buffers.
+	*
+	* @return void
+	*/
+	void cleanup();
+
+public:
+	/**
+	* @brief Constructor.
+	*
+	* @param passes - The number of passes.
+	*/
+	SceneBatch(std::size_t passes);
+	SceneBatch(const SceneBatch&) = delete;
+	SceneBatch& operator=(const SceneBatch&) = delete;
+	~SceneBatch() {
+		cleanup();
+	};
+
+	/**
+	* @brief Removes every mesh and object, e.g. to add the meshes loaded since. Takes effect on upload().
+	*
+	* @return void
+	*/
+	void clear();
+
+	/**
+	* @brief Places a model in the scene.
+	*
+	* @param pass - The pass drawing the object.
+	* @param model - The model, whose vertices are copied; it can be reused by any number of objects.
+	* @param model2world - The transformation of the object, affine.
+	*
+	* @return void
+	*/
+	void add(std::size_t, Model const&, Mat44f const&);
+
+	/**
+	* @brief Uploads the meshes and objects added since the last clear(). Needs the GL context.
+	*
+	* @return void
+	*/
+	void upload();
+
+	/**
+	* @brief Draws all the objects of a pass in one call.
+	*
+	* @param pass - The pass to draw.
+	* @param cameraPosition - The current camera position in world coordinates.
+	* @param light - The light of the scene.
+	* @param world2projection - The product of the projection and world2camera matrices.
+	* @param shaderProgram - The batched shader program.
+	*
+	* @return void
+	*/
+	void render(std::size_t, Vec3f, Light const&, Mat44f const&, GLuint);
+};
@@ -1,8 +1,53 @@
 #include "Shader.hpp"
 
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+namespace {
+    // Program binaries of every shader, one file each
+    constexpr const char* BINARY_CACHE_DIRECTORY = "assets/shaders/cache";
+
+    // Changed whenever the layout of the cache files changes
+    constexpr uint32_t BINARY_CACHE_VERSION = 1;
+    constexpr char BINARY_CACHE_MAGIC[4] = { 'B', 'P', 'R', 'G' };
+
+    // Start of a cache file, followed by the binary
+    struct BinaryHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    // FNV-1a, 64 bits
+    uint64_t hash(uint64_t value, std::string const& text)
+    {
+        for (unsigned char c : text)
+            value = (value ^ c) * 0x100000001b3ull;
+        // Separator, so that moving text between the strings changes the hash
+        return (value ^ 0xff) * 0x100000001b3ull;
+    }
+
+    uint64_t binaryKey(std::string const& vertexSource, std::string const& fragmentSource)
+    {
+        uint64_t key = 0xcbf29ce484222325ull;
+        key = hash(key, vertexSource);
+        key = hash(key, fragmentSource);
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            const char* value = (const char*)glGetString(name);
+            key = hash(key, value ? value : "");
+        }
+        return key;
+    }
+}
+
 
 // load shader from file into a string
-GLchar* Shader::readShader(const char* sourcePath) {
+std::string Shader::readShader(const char* sourcePath) {
     FILE* file = fopen(sourcePath, "rb");
     if (!file) {
         printf("Error: unable to open shader source file\n");
@@ -14,32 +59,24 @@ GLchar* Shader::readShader(const char* sourcePath) {
     size_t size = ftell(file);
     rewind(file);
 
-    // Allocate a buffer to hold the file contents
-    char* buffer = new char[size + 1];
-    if (!buffer) {
-        printf("Error: unable to allocate memory for shader source\n");
-        fclose(file);
-        return {};
-    }
-
-    // Read the file contents into the buffer
-    size_t read_size = fread(buffer, 1, size, file);
+    // Read the file contents into the string
+    std::string buffer(size, '\0');
+    size_t read_size = fread(&buffer[0], 1, size, file);
     if (read_size != size) {
         printf("Error: unable to read shader source file\n");
-        delete[] buffer;
         fclose(file);
         return {};
     }
 
     fclose(file);
-    buffer[size] = '\0';
     return buffer;
 }
 
 unsigned int Shader::setupVertexShader()
 {
     unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+    const GLchar* source = vertexShaderSource.c_str();
+    glShaderSource(vertexShader, 1, &source, NULL);
     glCompileShader(vertexShader);
 
     int success;
@@ -59,7 +96,8 @@ unsigned int Shader::setupVertexShader()
 unsigned int Shader::setupFragmentShader()
 {
     unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+    const GLchar* source = fragmentShaderSource.c_str();
+    glShaderSource(fragmentShader, 1, &source, NULL);
     glCompileShader(fragmentShader);
 
     int  success;
@@ -91,6 +129,7 @@ Shader::ShaderData Shader::setupShaderProgram()
 
     glAttachShader(result.shaderProgram, result.vertexShader);
     glAttachShader(result.shaderProgram, result.fragmentShader);
+    glProgramParameteri(result.shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(result.shaderProgram);
 
     int  success;
@@ -105,4 +144,92 @@ Shader::ShaderData Shader::setupShaderProgram()
 
     result.success = true;
     return result;
-}
\ No newline at end of file
+}
+
+std::string Shader::binaryCachePath() const
+{
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount == 0)
+        return {};
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)binaryKey(vertexShaderSource, fragmentShaderSource));
+    return BINARY_CACHE_DIRECTORY + std::string(name);
+}
+
+bool Shader::loadProgramBinary(std::string const& path)
+{
+    if (path.empty())
+        return false;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    // The key is checked too, the file name being only its hexadecimal form
+    BinaryHeader header;
+    std::vector<char> binary;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1
+        && std::memcmp(header.magic, BINARY_CACHE_MAGIC, sizeof(header.magic)) == 0
+        && header.version == BINARY_CACHE_VERSION
+        && header.key == binaryKey(vertexShaderSource, fragmentShaderSource)
+        && header.length > 0;
+    if (valid) {
+        binary.resize(header.length);
+        valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+    }
+    fclose(file);
+    if (!valid)
+        return false;
+
+    // Drivers may still reject a binary, e.g. after an update that kept the version string
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        return false;
+    }
+
+    this->data = ShaderData{ program, 0, 0, true };
+    return true;
+}
+
+void Shader::saveProgramBinary(std::string const& path) const
+{
+    if (path.empty())
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(this->data.shaderProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(this->data.shaderProgram, length, &length, &format, binary.data());
+    if (length <= 0)
+        return;
+
+    BinaryHeader header{ {}, BINARY_CACHE_VERSION, binaryKey(vertexShaderSource, fragmentShaderSource), format, (uint32_t)length };
+    std::memcpy(header.magic, BINARY_CACHE_MAGIC, sizeof(header.magic));
+
+    // Written aside and renamed, so that an interrupted write never leaves a truncated binary
+    std::error_code error;
+    std::filesystem::create_directories(BINARY_CACHE_DIRECTORY, error);
+    std::string partialPath = path + ".partial";
+    FILE* file = fopen(partialPath.c_str(), "wb");
+    if (!file) {
+        std::printf("Unable to write the program binary %s\n", path.c_str());
+        return;
+    }
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(binary.data(), 1, (std::size_t)length, file) == (std::size_t)length;
+    success = fclose(file) == 0 && success;
+    if (success)
+        std::filesystem::rename(partialPath, path, error);
+    if (!success || error) {
+        std::printf("Unable to write the program binary %s\n", path.c_str());
+        std::filesystem::remove(partialPath, error);
+    }
+}
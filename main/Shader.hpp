@@ -3,6 +3,7 @@
 #include <glad.h>
 
 #include <fstream>
+#include <string>
 
 
 /**
@@ -20,17 +21,17 @@ private:
 		bool success;
 	};
 
-	const GLchar* vertexShaderSource = "";
-	const GLchar* fragmentShaderSource = "";
-	
+	std::string vertexShaderSource;
+	std::string fragmentShaderSource;
+
 	/**
 	* @brief Reads the shader source code from a file into a string.
 	* 
 	* @param sourcePath - Path to the shader source file.
 	*
-	* @return string of the shader source.
+	* @return string of the shader source, empty if it could not be read.
 	*/
-	GLchar* readShader(const char* sourcePath);
+	static std::string readShader(const char* sourcePath);
 	
 	/**
 	* @brief Compiles the vertex shader.
@@ -53,6 +54,33 @@ private:
 	*/
 	ShaderData setupShaderProgram();
 
+	/**
+	* @brief Path of the program binary cache file of this shader, named after a hash of the sources
+	* and of the vendor, renderer and version strings of the driver, so that a binary is only reused
+	* by the driver that made it. Needs the GL context.
+	*
+	* @return The path, empty if the driver has no program binary format.
+	*/
+	std::string binaryCachePath() const;
+
+	/**
+	* @brief Creates the program from a binary cached by an earlier launch, with glProgramBinary.
+	*
+	* @param path - Path to the cache file, see binaryCachePath.
+	*
+	* @return Whether the binary was found and accepted by the driver; if not, the shader must be compiled.
+	*/
+	bool loadProgramBinary(std::string const& path);
+
+	/**
+	* @brief Saves the linked program with glGetProgramBinary, for the next launches.
+	*
+	* @param path - Path to the cache file, see binaryCachePath.
+	*
+	* @return void.
+	*/
+	void saveProgramBinary(std::string const& path) const;
+
 	/**
 	* @brief Deletes ShaderData associated with current object.
 	*
@@ -66,18 +94,52 @@ private:
 	
 public:
 	ShaderData data;
-	
+
+	/**
+	* @brief The source code of the two stages of a shader, read before the program is compiled.
+	*/
+	struct Sources {
+		std::string vertex;
+		std::string fragment;
+	};
+
+	/**
+	* @brief Reads the source code of a shader from the given files. Does not touch GL,
+	* so it can run on any thread.
+	*
+	* @param vertSource - Path to the vertex shader source file.
+	* @param fragSource - Path to the fragment shader source file.
+	*
+	* @return The sources of both stages.
+	*/
+	static Sources read(const char* vertSource, const char* fragSource) {
+		return Sources{ readShader(vertSource), readShader(fragSource) };
+	}
+
 	/**
 	* @brief Constructor for a shader. Reads the shader source code from the given files and compiles them.
 	*/
-	Shader(const char* vertSource, const char* fragSource) {
-		vertexShaderSource = readShader(vertSource);
-		fragmentShaderSource = readShader(fragSource);
+	Shader(const char* vertSource, const char* fragSource) : Shader(read(vertSource, fragSource)) {}
+
+	/**
+	* @brief Constructor for a shader whose source code was already read. Loads the program binary
+	* cached by an earlier launch if the driver accepts it, otherwise compiles the sources and caches the binary.
+	*/
+	Shader(Sources const& sources) {
+		vertexShaderSource = sources.vertex;
+		fragmentShaderSource = sources.fragment;
+		std::string cachePath = binaryCachePath();
+		if (loadProgramBinary(cachePath))
+			return;
 		data = setupShaderProgram();
 		if (!data.success)
 		{
 			printf("Shader compilation failed.");
 		}
+		else
+		{
+			saveProgramBinary(cachePath);
+		}
 	};
 
 	~Shader() {
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cmath>
+
+#include "../math/vec3.hpp"
+
+/**
+* @brief Axis-aligned volume the boids live in. Boids spawn inside it and are
+* steered back when they get closer than edgeLimit to one of its faces.
+* In periodic mode the volume is a 3-torus instead: there are no walls, boids
+* leaving through a face re-enter through the opposite one and see across it.
+*/
+struct SimulationBounds {
+	Vec3f min = { -100.f, 0.f, -100.f };
+	Vec3f max = { 100.f, 50.f, 100.f };
+	float edgeLimit = 2.f;
+	bool periodic = false;
+
+	/**
+	* @brief Size of the volume on each axis.
+	*/
+	Vec3f size() const {
+		return max - min;
+	}
+
+	/**
+	* @brief Centre of the volume.
+	*/
+	Vec3f centre() const {
+		return (min + max) / 2.f;
+	}
+
+	/**
+	* @brief Lower corner of the volume the boids are kept in.
+	*/
+	Vec3f innerMin() const {
+		return min + Vec3f{ edgeLimit, edgeLimit, edgeLimit };
+	}
+
+	/**
+	* @brief Upper corner of the volume the boids are kept in.
+	*/
+	Vec3f innerMax() const {
+		return max - Vec3f{ edgeLimit, edgeLimit, edgeLimit };
+	}
+
+	/**
+	* @brief Shortest vector from one position to another, across the faces in periodic mode.
+	*
+	* @param from - The start position.
+	* @param to - The end position.
+	*
+	* @return Vec3f The displacement to - from (minimum image in periodic mode).
+	*/
+	Vec3f displacement(Vec3f from, Vec3f to) const {
+		Vec3f d = to - from;
+		if (periodic) {
+			Vec3f s = size();
+			for (int axis = 0; axis < 3; axis++) {
+				if (d[axis] > s[axis] / 2.f) d[axis] -= s[axis];
+				else if (d[axis] < -s[axis] / 2.f) d[axis] += s[axis];
+			}
+		}
+		return d;
+	}
+
+	/**
+	* @brief Brings a position that left the volume back in through the opposite face.
+	* Does nothing if the bounds are not periodic.
+	*
+	* @param position - The position to wrap.
+	*
+	* @return Vec3f The wrapped position.
+	*/
+	Vec3f wrap(Vec3f position) const {
+		if (periodic) {
+			Vec3f s = size();
+			for (int axis = 0; axis < 3; axis++) {
+				if (position[axis] < min[axis] || position[axis] >= max[axis])
+					position[axis] -= std::floor((position[axis] - min[axis]) / s[axis]) * s[axis];
+			}
+		}
+		return position;
+	}
+
+	/**
+	* @brief Volume in cubic units.
+	*/
+	float volume() const {
+		Vec3f s = size();
+		return s.x * s.y * s.z;
+	}
+
+	/**
+	* @brief Creates bounds around the same centre and with the same height, whose horizontal
+	* extent is scaled so that the given number of boids has the given density.
+	*
+	* @param reference - The bounds whose centre, height and aspect ratio are kept.
+	* @param boidCount - The number of boids in the volume.
+	* @param density - The number of boids per cubic unit.
+	*
+	* @return SimulationBounds The scaled bounds.
+	*/
+	static SimulationBounds withDensity(SimulationBounds const& reference, int boidCount, float density) {
+		SimulationBounds result = reference;
+		if (boidCount <= 0 || density <= 0.f)
+			return result;
+
+		float scale = std::sqrt(boidCount / density / reference.volume());
+		Vec3f half = reference.size() / 2.f;
+		Vec3f c = reference.centre();
+		result.min = Vec3f{ c.x - half.x * scale, reference.min.y, c.z - half.z * scale };
+		result.max = Vec3f{ c.x + half.x * scale, reference.max.y, c.z + half.z * scale };
+		return result;
+	}
+};
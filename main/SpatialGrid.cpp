@@ -0,0 +1,84 @@
+#include "SpatialGrid.hpp"
+
+void SpatialGrid::build(SimulationBounds const& bounds, float requestedCellSize, Vec3f const* positions, std::size_t count, std::size_t stride)
+{
+    // Grow the cells until the grid fits in MAX_CELLS (tiny search radius or huge bounds)
+    Vec3f size = bounds.size();
+    float minimumSize = requestedCellSize > 0.5f ? requestedCellSize : 0.5f;
+    this->periodic = bounds.periodic;
+    for (;;) {
+        for (int axis = 0; axis < 3; axis++) {
+            // Periodic cells must tile the volume exactly, so they are stretched to fit;
+            // otherwise the last cell may overhang the bounds
+            int cells = this->periodic ? (int)std::floor(size[axis] / minimumSize) : (int)std::ceil(size[axis] / minimumSize);
+            this->dims[axis] = cells > 0 ? cells : 1;
+            this->cellSize[axis] = this->periodic ? size[axis] / this->dims[axis] : minimumSize;
+            this->inverseCellSize[axis] = 1.f / this->cellSize[axis];
+        }
+        if (cellCount() <= (std::size_t)MAX_CELLS)
+            break;
+        minimumSize *= 2.f;
+    }
+    this->origin = bounds.min;
+    this->boundsSize = size;
+
+    // Counting sort of the boids by cell
+    std::size_t cells = cellCount();
+    this->cellStart.assign(cells + 1, 0);
+    this->boidCells.resize(count);
+    this->entries.resize(count);
+
+    unsigned char const* bytes = reinterpret_cast<unsigned char const*>(positions);
+    for (std::size_t i = 0; i < count; i++) {
+        Vec3f const& p = *reinterpret_cast<Vec3f const*>(bytes + i * stride);
+        uint32_t cell = (uint32_t)((cellCoordinate(p.z, 2) * this->dims[1] + cellCoordinate(p.y, 1)) * this->dims[0] + cellCoordinate(p.x, 0));
+        this->boidCells[i] = cell;
+        this->cellStart[cell + 1]++;
+    }
+    for (std::size_t c = 0; c < cells; c++)
+        this->cellStart[c + 1] += this->cellStart[c];
+
+    // Scatter, using the start of each cell as a running cursor
+    for (std::size_t i = 0; i < count; i++)
+        this->entries[this->cellStart[this->boidCells[i]]++] = (uint32_t)i;
+    // The cursors now hold the end of each cell, i.e. the start of the next one
+    for (std::size_t c = cells; c > 0; c--)
+        this->cellStart[c] = this->cellStart[c - 1];
+    this->cellStart[0] = 0;
+}
+
+void SpatialGrid::buildAggregates(Vec3f const* positions, Vec3f const* directions, std::size_t stride)
+{
+    // Level 0: one aggregate per cell
+    this->levels.clear();
+    this->levels.push_back(Level{ { this->dims[0], this->dims[1], this->dims[2] }, 0 });
+    this->aggregates.assign(cellCount(), Aggregate{ { 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f }, 0 });
+
+    unsigned char const* positionBytes = reinterpret_cast<unsigned char const*>(positions);
+    unsigned char const* directionBytes = reinterpret_cast<unsigned char const*>(directions);
+    for (std::size_t i = 0; i < this->boidCells.size(); i++) {
+        Aggregate& cell = this->aggregates[this->boidCells[i]];
+        cell.positionSum += *reinterpret_cast<Vec3f const*>(positionBytes + i * stride);
+        cell.directionSum += *reinterpret_cast<Vec3f const*>(directionBytes + i * stride);
+        cell.count++;
+    }
+
+    // Every level above merges the 2x2x2 blocks of the one below, until one block is left
+    while (this->levels.back().dims[0] > 1 || this->levels.back().dims[1] > 1 || this->levels.back().dims[2] > 1) {
+        Level below = this->levels.back();
+        Level level{ { (below.dims[0] + 1) / 2, (below.dims[1] + 1) / 2, (below.dims[2] + 1) / 2 }, this->aggregates.size() };
+        this->levels.push_back(level);
+        this->aggregates.resize(level.first + (std::size_t)level.dims[0] * level.dims[1] * level.dims[2], Aggregate{ { 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f }, 0 });
+        for (int z = 0; z < below.dims[2]; z++) {
+            for (int y = 0; y < below.dims[1]; y++) {
+                for (int x = 0; x < below.dims[0]; x++) {
+                    Aggregate const& child = this->aggregates[below.first + ((std::size_t)z * below.dims[1] + y) * below.dims[0] + x];
+                    Aggregate& parent = this->aggregates[level.first + ((std::size_t)(z / 2) * level.dims[1] + y / 2) * level.dims[0] + x / 2];
+                    parent.positionSum += child.positionSum;
+                    parent.directionSum += child.directionSum;
+                    parent.count += child.count;
+                }
+            }
+        }
+    }
+}
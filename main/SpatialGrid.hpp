@@ -0,0 +1,357 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "SimulationBounds.hpp"
+#include "../math/vec3.hpp"
+
+/**
+* @brief Uniform grid over the simulation bounds used to find the boids near a position.
+* Built once per tick with a counting sort: the boids of a cell are stored contiguously,
+* so a query only touches the cells overlapping the search radius.
+* Boids outside the bounds are kept in the border cells. With periodic bounds the cells
+* tile the volume exactly and a query reaching past a face continues in the cells of the
+* opposite face (ghost cells are resolved by wrapping the cell index, nothing is copied).
+* Optionally, a pyramid of cell aggregates can be built on top of the cells for approximate
+* Barnes-Hut style queries, where distant blocks of cells stand in for their boids.
+*/
+class SpatialGrid {
+public:
+	/**
+	* @brief Summary of the boids of a cell or of a block of cells.
+	*/
+	struct Aggregate {
+		Vec3f positionSum;
+		Vec3f directionSum;
+		uint32_t count;
+	};
+
+private:
+	static constexpr int MAX_CELLS = 1 << 21;
+
+	// Level of the aggregate pyramid: level 0 has one aggregate per cell, every level
+	// above merges blocks of 2x2x2 aggregates of the one below, up to a single block
+	struct Level {
+		int dims[3];
+		std::size_t first;	// index of its first aggregate
+	};
+
+	Vec3f origin = {};
+	Vec3f cellSize = { 1.f, 1.f, 1.f };
+	Vec3f inverseCellSize = { 1.f, 1.f, 1.f };
+	int dims[3] = { 1, 1, 1 };
+	bool periodic = false;
+
+	std::vector<uint32_t> cellStart;	// first entry of each cell, with one extra end marker
+	std::vector<uint32_t> entries;		// indices of the boids, sorted by cell
+	std::vector<uint32_t> boidCells;	// cell of each boid, reused between builds
+
+	Vec3f boundsSize = {};
+	std::vector<Level> levels;
+	std::vector<Aggregate> aggregates;
+
+	int cellCoordinate(float value, int axis) const {
+		int c = (int)std::floor((value - origin[axis]) * inverseCellSize[axis]);
+		return c < 0 ? 0 : c >= dims[axis] ? dims[axis] - 1 : c;
+	}
+
+	int wrapCoordinate(int c, int axis) const {
+		c %= dims[axis];
+		return c < 0 ? c + dims[axis] : c;
+	}
+
+	// Visits the boids or the aggregates of a block of the pyramid and of its children
+	template<class BoidVisitor, class AggregateVisitor>
+	void visitBlock(int level, int const block[3], Vec3f position, float radius, float theta,
+		BoidVisitor& visitBoid, AggregateVisitor& visitAggregate) const {
+		Level const& l = levels[level];
+		std::size_t index = ((std::size_t)block[2] * l.dims[1] + block[1]) * l.dims[0] + block[0];
+		Aggregate const& aggregate = aggregates[l.first + index];
+		if (aggregate.count == 0)
+			return;
+
+		// Distance from the position to the box of the block
+		float gap2 = 0.f;
+		float extent = 0.f;
+		for (int axis = 0; axis < 3; axis++) {
+			int firstCell = block[axis] << level;
+			int endCell = (firstCell + (1 << level)) < dims[axis] ? firstCell + (1 << level) : dims[axis];
+			float lo = origin[axis] + firstCell * cellSize[axis];
+			float hi = origin[axis] + endCell * cellSize[axis];
+			float gap;
+			if (periodic) {
+				float half = (hi - lo) / 2.f;
+				float d = position[axis] - (lo + half);
+				if (d > boundsSize[axis] / 2.f) d -= boundsSize[axis];
+				else if (d < -boundsSize[axis] / 2.f) d += boundsSize[axis];
+				gap = std::fabs(d) - half;
+			}
+			else {
+				// The border blocks also hold the boids outside the bounds
+				if (firstCell == 0) lo = -std::numeric_limits<float>::infinity();
+				if (endCell == dims[axis]) hi = std::numeric_limits<float>::infinity();
+				gap = lo - position[axis] > position[axis] - hi ? lo - position[axis] : position[axis] - hi;
+			}
+			if (gap > 0.f)
+				gap2 += gap * gap;
+			if (hi - lo > extent)
+				extent = hi - lo;
+		}
+		if (gap2 >= radius * radius)
+			return;
+
+		if (level == 0) {
+			for (uint32_t e = cellStart[index]; e < cellStart[index + 1]; e++)
+				visitBoid(entries[e]);
+			return;
+		}
+
+		// A block far enough away, seen under an angle smaller than theta, stands in for its boids;
+		// the blocks around the position are always opened
+		if (gap2 > 0.f) {
+			Vec3f offset = aggregate.positionSum / (float)aggregate.count - position;
+			if (periodic) {
+				for (int axis = 0; axis < 3; axis++) {
+					if (offset[axis] > boundsSize[axis] / 2.f) offset[axis] -= boundsSize[axis];
+					else if (offset[axis] < -boundsSize[axis] / 2.f) offset[axis] += boundsSize[axis];
+				}
+			}
+			if (extent < theta * length(offset)) {
+				visitAggregate(aggregate, offset);
+				return;
+			}
+		}
+
+		Level const& below = levels[level - 1];
+		int child[3];
+		for (child[2] = block[2] * 2; child[2] < block[2] * 2 + 2 && child[2] < below.dims[2]; child[2]++)
+			for (child[1] = block[1] * 2; child[1] < block[1] * 2 + 2 && child[1] < below.dims[1]; child[1]++)
+				for (child[0] = block[0] * 2; child[0] < block[0] * 2 + 2 && child[0] < below.dims[0]; child[0]++)
+					visitBlock(level - 1, child, position, radius, theta, visitBoid, visitAggregate);
+	}
+
+public:
+	/**
+	* @brief Rebuilds the grid for the given positions.
+	*
+	* @param bounds - The simulation bounds covered by the grid.
+	* @param cellSize - The minimum edge length of a cell, usually the search radius.
+	* @param positions - Pointer to the first position.
+	* @param count - The number of positions.
+	* @param stride - The distance in bytes between two positions.
+	*
+	* @return void
+	*/
+	void build(SimulationBounds const&, float, Vec3f const*, std::size_t, std::size_t stride = sizeof(Vec3f));
+
+	/**
+	* @brief Calls visit(index) for every entry in the cells overlapping the sphere
+	* around position. The visited entries are a superset of the ones inside the sphere.
+	*
+	* @param position - The centre of the query.
+	* @param radius - The radius of the query.
+	* @param visit - Callable taking the uint32_t index of a boid.
+	*
+	* @return void
+	*/
+	template<class Visitor>
+	void forEachCandidate(Vec3f position, float radius, Visitor&& visit) const {
+		int lo[3], hi[3];
+		for (int axis = 0; axis < 3; axis++) {
+			if (periodic) {
+				// Unclamped range, wrapped below; a range covering the whole axis is visited once
+				lo[axis] = (int)std::floor((position[axis] - radius - origin[axis]) * inverseCellSize[axis]);
+				hi[axis] = (int)std::floor((position[axis] + radius - origin[axis]) * inverseCellSize[axis]);
+				if (hi[axis] - lo[axis] + 1 >= dims[axis]) {
+					lo[axis] = 0;
+					hi[axis] = dims[axis] - 1;
+				}
+			}
+			else {
+				lo[axis] = cellCoordinate(position[axis] - radius, axis);
+				hi[axis] = cellCoordinate(position[axis] + radius, axis);
+			}
+		}
+		for (int z = lo[2]; z <= hi[2]; z++) {
+			for (int y = lo[1]; y <= hi[1]; y++) {
+				// Cells along x are contiguous, so a row is a single range of entries,
+				// or two when it wraps around the periodic face
+				int rowCell = (wrapCoordinate(z, 2) * dims[1] + wrapCoordinate(y, 1)) * dims[0];
+				for (int x = lo[0]; x <= hi[0];) {
+					int cell = wrapCoordinate(x, 0);
+					int run = hi[0] - x + 1 < dims[0] - cell ? hi[0] - x + 1 : dims[0] - cell;
+					uint32_t first = cellStart[rowCell + cell];
+					uint32_t last = cellStart[rowCell + cell + run];
+					for (uint32_t e = first; e < last; e++)
+						visit(entries[e]);
+					x += run;
+				}
+			}
+		}
+	}
+
+	/**
+	* @brief Calls visit(index) for every entry in the cells around position, ring by ring: ring r is
+	* made of the cells r cells away (Chebyshev distance) from the cell of position. Before every
+	* ring but the first, calls proceed(distance) with a lower bound of the distance from position
+	* to the cells of that ring, and stops as soon as it returns false.
+	*
+	* @param position - The centre of the query.
+	* @param visit - Callable taking the uint32_t index of a boid.
+	* @param proceed - Callable taking the float distance to the next ring, returning bool.
+	*
+	* @return void
+	*/
+	template<class Visitor, class Proceed>
+	void forEachCandidateByRing(Vec3f position, Visitor&& visit, Proceed&& proceed) const {
+		// Cell of the position, the distance to its nearest face and how many rings fit on each
+		// side of it on every axis (with periodic bounds, half the grid each way so no cell repeats)
+		int centre[3], below[3], above[3];
+		float toFace = 0.f;
+		for (int axis = 0; axis < 3; axis++) {
+			if (periodic) {
+				centre[axis] = wrapCoordinate((int)std::floor((position[axis] - origin[axis]) * inverseCellSize[axis]), axis);
+				below[axis] = (dims[axis] - 1) / 2;
+				above[axis] = dims[axis] / 2;
+			}
+			else {
+				centre[axis] = cellCoordinate(position[axis], axis);
+				below[axis] = centre[axis];
+				above[axis] = dims[axis] - 1 - centre[axis];
+			}
+			float lo = position[axis] - (origin[axis] + centre[axis] * cellSize[axis]);
+			float hi = origin[axis] + (centre[axis] + 1) * cellSize[axis] - position[axis];
+			float face = lo < hi ? lo : hi;
+			if (axis == 0 || face < toFace)
+				toFace = face;
+		}
+		int rings = 0;
+		for (int axis = 0; axis < 3; axis++) {
+			rings = below[axis] > rings ? below[axis] : rings;
+			rings = above[axis] > rings ? above[axis] : rings;
+		}
+		float smallest = cellSize.x < cellSize.y ? (cellSize.x < cellSize.z ? cellSize.x : cellSize.z) : (cellSize.y < cellSize.z ? cellSize.y : cellSize.z);
+
+		for (int r = 0; r <= rings; r++) {
+			if (r > 0) {
+				float distance = (r - 1) * smallest + (toFace > 0.f ? toFace : 0.f);
+				if (!proceed(distance))
+					return;
+			}
+			int zLo = -(r < below[2] ? r : below[2]), zHi = r < above[2] ? r : above[2];
+			int yLo = -(r < below[1] ? r : below[1]), yHi = r < above[1] ? r : above[1];
+			for (int dz = zLo; dz <= zHi; dz++) {
+				int z = periodic ? wrapCoordinate(centre[2] + dz, 2) : centre[2] + dz;
+				for (int dy = yLo; dy <= yHi; dy++) {
+					int y = periodic ? wrapCoordinate(centre[1] + dy, 1) : centre[1] + dy;
+					int rowCell = (z * dims[1] + y) * dims[0];
+					// On the faces of the shell the whole row belongs to the ring, inside it only its two ends
+					bool face = dz == -r || dz == r || dy == -r || dy == r;
+					for (int dx = -r; dx <= r; dx += face || r == 0 ? 1 : 2 * r) {
+						if (dx < -below[0] || dx > above[0])
+							continue;
+						int cell = rowCell + (periodic ? wrapCoordinate(centre[0] + dx, 0) : centre[0] + dx);
+						for (uint32_t e = cellStart[cell]; e < cellStart[cell + 1]; e++)
+							visit(entries[e]);
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	* @brief Builds the aggregate pyramid over the cells of the last build(), for forEachSample().
+	*
+	* @param positions - Pointer to the first position, the same as given to build().
+	* @param directions - Pointer to the first direction.
+	* @param stride - The distance in bytes between two positions, and between two directions.
+	*
+	* @return void
+	*/
+	void buildAggregates(Vec3f const*, Vec3f const*, std::size_t stride = sizeof(Vec3f));
+
+	/**
+	* @brief Approximate query, Barnes-Hut style: descends the aggregate pyramid from the blocks the size of the query and
+	* calls visitAggregate(aggregate, offset) for the blocks that overlap the sphere around position
+	* and are seen under an angle (block edge / distance to their centre of mass) below theta,
+	* and visit(index) for the entries of the cells reached otherwise. theta = 0 opens every block.
+	* Requires buildAggregates() after the last build().
+	*
+	* @param position - The centre of the query.
+	* @param radius - The radius of the query.
+	* @param theta - The opening angle, the larger the coarser.
+	* @param visit - Callable taking the uint32_t index of a boid.
+	* @param visitAggregate - Callable taking an Aggregate const& and the Vec3f offset from position to its centre of mass.
+	*
+	* @return void
+	*/
+	template<class BoidVisitor, class AggregateVisitor>
+	void forEachSample(Vec3f position, float radius, float theta, BoidVisitor&& visit, AggregateVisitor&& visitAggregate) const {
+		// Start from the finest level whose blocks are as large as the query, so that it
+		// overlaps at most 2 blocks per axis, or 3 when wrapping onto a partial block
+		float smallest = cellSize.x < cellSize.y ? (cellSize.x < cellSize.z ? cellSize.x : cellSize.z) : (cellSize.y < cellSize.z ? cellSize.y : cellSize.z);
+		int start = 0;
+		while (start + 1 < (int)levels.size() && smallest * (float)(1 << start) < 2.f * radius)
+			start++;
+
+		Level const& level = levels[start];
+		int blocks[3][3];
+		int count[3];
+		for (int axis = 0; axis < 3; axis++) {
+			count[axis] = 0;
+			if (level.dims[axis] <= 3) {
+				for (int b = 0; b < level.dims[axis]; b++)
+					blocks[axis][count[axis]++] = b;
+				continue;
+			}
+			int lo, hi;
+			if (periodic) {
+				lo = (int)std::floor((position[axis] - radius - origin[axis]) * inverseCellSize[axis]);
+				hi = (int)std::floor((position[axis] + radius - origin[axis]) * inverseCellSize[axis]);
+			}
+			else {
+				lo = cellCoordinate(position[axis] - radius, axis);
+				hi = cellCoordinate(position[axis] + radius, axis);
+			}
+			for (int x = lo; x <= hi;) {
+				int cell = periodic ? wrapCoordinate(x, axis) : x;
+				int b = cell >> start;
+				bool seen = false;
+				for (int i = 0; i < count[axis]; i++)
+					seen |= blocks[axis][i] == b;
+				if (!seen)
+					blocks[axis][count[axis]++] = b;
+				int next = (b + 1) << start;
+				x += (next < dims[axis] ? next : dims[axis]) - cell;
+			}
+		}
+
+		int block[3];
+		for (int k = 0; k < count[2]; k++) {
+			block[2] = blocks[2][k];
+			for (int j = 0; j < count[1]; j++) {
+				block[1] = blocks[1][j];
+				for (int i = 0; i < count[0]; i++) {
+					block[0] = blocks[0][i];
+					visitBlock(start, block, position, radius, theta, visit, visitAggregate);
+				}
+			}
+		}
+	}
+
+	/**
+	* @brief Number of cells in the grid.
+	*/
+	std::size_t cellCount() const {
+		return (std::size_t)dims[0] * dims[1] * dims[2];
+	}
+
+	/**
+	* @brief Edge lengths of a cell.
+	*/
+	Vec3f getCellSize() const {
+		return cellSize;
+	}
+};
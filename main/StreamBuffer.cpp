@@ -0,0 +1,117 @@
+#include "StreamBuffer.hpp"
+
+#include <cstdio>
+
+namespace {
+    // Growth when the data of a frame does not fit, to avoid recreating the buffer every frame
+    constexpr std::size_t GROWTH = 2;
+
+    // Nanoseconds between checks of a fence while waiting for it
+    constexpr GLuint64 FENCE_TIMEOUT = 1000000;
+}
+
+void StreamBuffer::waitFor(std::size_t region)
+{
+    GLsync& fence = this->fences[region];
+    if (!fence)
+        return;
+
+    // Flush on the first wait, so that the fence is sure to be signaled eventually
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (true) {
+        GLenum result = glClientWaitSync(fence, flags, FENCE_TIMEOUT);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+            break;
+        if (result != GL_TIMEOUT_EXPIRED) {
+            printf("StreamBuffer: waiting for a fence failed\n");
+            break;
+        }
+        flags = 0;
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void StreamBuffer::allocate(std::size_t capacity)
+{
+    release();
+    this->allocations++;
+    this->capacity = capacity;
+    this->region = 0;
+    glGenBuffers(1, &this->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+
+    this->persistent = GLAD_GL_VERSION_4_4 != 0;
+    if (this->persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr size = (GLsizeiptr)(REGIONS * capacity * this->elementSize);
+        glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+        this->mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+        if (!this->mapped) {
+            printf("StreamBuffer: persistent mapping failed, uploading instead\n");
+            glDeleteBuffers(1, &this->buffer);
+            glGenBuffers(1, &this->buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+            this->persistent = false;
+        }
+    }
+    if (!this->persistent)
+        this->staging.resize(capacity * this->elementSize);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void StreamBuffer::release()
+{
+    if (this->buffer == 0)
+        return;
+    for (std::size_t i = 0; i < REGIONS; i++)
+        waitFor(i);
+    if (this->mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        this->mapped = nullptr;
+    }
+    glDeleteBuffers(1, &this->buffer);
+    this->buffer = 0;
+}
+
+void* StreamBuffer::begin(std::size_t count)
+{
+    if (count > this->capacity || this->buffer == 0) {
+        std::size_t capacity = this->capacity * GROWTH;
+        if (capacity < count)
+            capacity = count;
+        allocate(capacity > 0 ? capacity : 1);
+    }
+    else if (this->persistent) {
+        this->region = (this->region + 1) % REGIONS;
+    }
+
+    this->stagedBytes = count * this->elementSize;
+    if (!this->persistent)
+        return this->staging.data();
+
+    // The GPU may still be drawing from this region REGIONS frames ago
+    waitFor(this->region);
+    return this->mapped + this->region * this->capacity * this->elementSize;
+}
+
+void StreamBuffer::commit()
+{
+    if (this->persistent)
+        return;
+
+    // Orphan last frame's storage so the upload does not wait for the draws still reading it
+    glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+    glBufferData(GL_ARRAY_BUFFER, this->capacity * this->elementSize, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, this->stagedBytes, this->staging.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void StreamBuffer::fence()
+{
+    if (!this->persistent)
+        return;
+    this->fences[this->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <glad.h>
+
+#include <cstddef>
+#include <vector>
+
+/**
+* @brief GL buffer for an array rewritten every frame, e.g. per-instance transforms.
+* The buffer is split in REGIONS regions used in turn, one per frame, and is mapped once for
+* its whole lifetime (GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT), so the CPU writes straight
+* into the memory the GPU reads, from any thread, without a copy or a call into the driver.
+* A fence placed after the draws reading a region guards it until the GPU is done with it,
+* which only blocks when the CPU is REGIONS frames ahead of the GPU.
+* Without GL 4.4 (glBufferStorage), the data is written into a CPU copy and uploaded into
+* orphaned storage instead.
+*/
+class StreamBuffer {
+public:
+	static constexpr std::size_t REGIONS = 3;
+
+private:
+	GLuint buffer = 0;
+	std::size_t elementSize;
+	std::size_t capacity = 0;		// elements per region
+	std::size_t region = 0;			// region being written or read this frame
+	unsigned char* mapped = nullptr;	// start of the persistent mapping, null when not persistent
+	GLsync fences[REGIONS] = {};
+	unsigned int allocations = 0;	// number of times the buffer was created
+
+	bool persistent = false;
+	std::vector<unsigned char> staging;	// CPU copy uploaded by commit() when not persistent
+	std::size_t stagedBytes = 0;
+
+	/**
+	* @brief Waits until the GPU no longer reads a region.
+	*
+	* @param region - The index of the region.
+	*
+	* @return void
+	*/
+	void waitFor(std::size_t);
+
+	/**
+	* @brief Creates the buffer with room for the given number of elements per region.
+	*
+	* @param capacity - The number of elements of a region.
+	*
+	* @return void
+	*/
+	void allocate(std::size_t);
+
+	/**
+	* @brief Deletes the buffer and the fences, after the GPU is done with every region.
+	*
+	* @return void
+	*/
+	void release();
+
+public:
+	/**
+	* @brief Constructor, the buffer itself is created on first use.
+	*
+	* @param elementSize - The size in bytes of an element of the array.
+	*/
+	StreamBuffer(std::size_t elementSize) : elementSize(elementSize) {};
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+	~StreamBuffer() {
+		release();
+	};
+
+	/**
+	* @brief Moves on to the next region and returns where to write this frame's data. Needs the
+	* GL context; the memory returned can then be written from any thread until commit().
+	* The buffer is recreated, with a new name, if the data does not fit.
+	*
+	* @param count - The number of elements written this frame.
+	*
+	* @return Pointer to count elements of writable memory.
+	*/
+	void* begin(std::size_t);
+
+	/**
+	* @brief Makes the data written since begin() visible to the GPU. Needs the GL context,
+	* and the writes to be finished.
+	*
+	* @return void
+	*/
+	void commit();
+
+	/**
+	* @brief Marks the end of the draws reading this frame's region. Needs the GL context.
+	*
+	* @return void
+	*/
+	void fence();
+
+	/**
+	* @brief Name of the GL buffer. The buffer is replaced when it grows, see allocationCount.
+	*/
+	GLuint id() const {
+		return this->buffer;
+	}
+
+	/**
+	* @brief Number of times the buffer was created, to know when to bind it again: a new
+	* buffer can reuse the name of the one it replaces.
+	*/
+	unsigned int allocationCount() const {
+		return this->allocations;
+	}
+
+	/**
+	* @brief Index in the buffer of the first element of this frame's region, e.g. the base
+	* instance of the draws reading per-instance data from it.
+	*/
+	std::size_t firstElement() const {
+		return this->persistent ? this->region * this->capacity : 0;
+	}
+};
@@ -1,11 +1,13 @@
 #include "Terrain.hpp"
 
-Model generate_terrain(const char* heightmap, Material material, Mat44f transformMatrix) {
+MeshData generate_terrain_data(const char* heightmap, Material material, Mat44f transformMatrix) {
     std::vector<Vertex> vertices;
-    int width, height, nChannels;
-    unsigned char* data = stbi_load(heightmap,
-        &width, &height, &nChannels,
-        0);
+    // Only level 0, uncompressed: the heights are read as they are
+    TextureData texture = load_texture_data(heightmap, false, TextureCompression::None);
+    if (texture.levels.empty())
+        return MeshData{ {}, { material }, {} };
+    int width = texture.width, height = texture.height, nChannels = texture.channels;
+    unsigned char* data = texture.levels[0].data.data();
 
     Mat33f const N = mat33(transpose(invert(transformMatrix)));
 
@@ -48,7 +50,6 @@ Model generate_terrain(const char* heightmap, Material material, Mat44f transfor
             vertices.emplace_back(Vertex{ p3, n, Vec2f{} });
         }
     }
-    stbi_image_free(data);
 
     // Bottom of the terrain
     vertices.emplace_back(Vertex{ Vec3f{ -width / 2.0f, 0.f, -height/ 2.0f}, { 0.f, -1.f, 0.f }, Vec2f{} });
@@ -59,15 +60,13 @@ Model generate_terrain(const char* heightmap, Material material, Mat44f transfor
     vertices.emplace_back(Vertex{ Vec3f{ width / 2.0f, 0.f, height / 2.0f}, { 0.f, -1.f, 0.f }, Vec2f{} });
     vertices.emplace_back(Vertex{ Vec3f{ -width / 2.0f, 0.f, height / 2.0f}, { 0.f, -1.f, 0.f }, Vec2f{} });
 
-    for (auto& v : vertices) {
-        Vec4f p4{ v.positions.x, v.positions.y, v.positions.z, 1.f };
-        Vec4f t = transformMatrix * p4;
-        t /= t.w;
-
-        v.positions = Vec3f{ t.x, t.y, t.z };
+    // The transforms are affine, so the points need no perspective divide
+    transform_points(transformMatrix, &vertices.data()->positions, vertices.size(), sizeof(Vertex));
+    transform_vectors(N, &vertices.data()->normals, vertices.size(), sizeof(Vertex));
 
-        v.normals = N * v.normals;
-    }
+    return MeshData{ std::move(vertices), { material }, {} };
+}
 
-    return Model(vertices, material);
+Model generate_terrain(const char* heightmap, Material material, Mat44f transformMatrix) {
+    return Model(generate_terrain_data(heightmap, material, transformMatrix));
 }
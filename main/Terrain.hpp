@@ -1,10 +1,23 @@
 #pragma once
 
 #include "Model.hpp"
-#include "../third_party/stb/include/stb_image.h"
+#include "../math/batch.hpp"
+#include "TextureCache.hpp"
 
 #include <unordered_map>
 
+/**
+* @brief Uses a heightmap to create a terrain mesh made of triangles with vertices, normals and material.
+* The heightmap is read from the texture cache when it is up to date. Does not touch GL, so it can run on any thread.
+*
+* @param heightmap - The path for the heightmap used to create the terrain.
+* @param material - The material of the terrain.
+* @param transformMatrix - The matrix used to transform the terrain.
+*
+* @return The terrain's vertices and material.
+*/
+MeshData generate_terrain_data(const char* heightmap, Material material, Mat44f transformMatrix = Identity44f);
+
 /**
 * @brief Uses a heightmap to create a terrain mesh made of triangles with vertices, normals and material.
 *
@@ -0,0 +1,360 @@
+#include "TextureCache.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+#include "../third_party/stb/include/stb_image.h"
+
+namespace {
+    // Not in the generated GL loader, GL_EXT_texture_compression_s3tc
+    constexpr GLenum COMPRESSED_RGB_S3TC_DXT1 = 0x83F0;
+
+    // Changed whenever the layout of the cache files or the encoding changes
+    constexpr uint32_t CACHE_VERSION = 2;
+    constexpr char CACHE_MAGIC[4] = { 'B', 'T', 'E', 'X' };
+
+    // Start of a cache file, followed by a LevelHeader and the data of each level
+    struct CacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        int32_t width, height, channels;
+        uint32_t compression;	// requested, the key
+        uint32_t encoding;		// of the stored levels, none for images the compression does not apply to
+        uint32_t mipmaps;
+        uint32_t levelCount;
+    };
+
+    struct LevelHeader {
+        int32_t width, height;
+        uint64_t size;
+    };
+
+    // Size and modification time of the source, to tell whether a cache file is out of date
+    bool source_stamp(const char* path, uint64_t& size, int64_t& time)
+    {
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if (error)
+            return false;
+        time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+        return !error;
+    }
+
+    std::size_t level_size(int width, int height, int channels, TextureCompression compression)
+    {
+        if (compression == TextureCompression::BC1)
+            return (std::size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+        return (std::size_t)width * height * channels;
+    }
+
+    bool read_cache(std::string const& cachePath, CacheHeader const& expected, TextureData& texture)
+    {
+        FILE* file = fopen(cachePath.c_str(), "rb");
+        if (!file)
+            return false;
+
+        CacheHeader header;
+        bool valid = fread(&header, sizeof(header), 1, file) == 1
+            && std::memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0
+            && header.version == expected.version
+            && header.sourceSize == expected.sourceSize
+            && header.sourceTime == expected.sourceTime
+            && header.compression == expected.compression
+            && header.mipmaps == expected.mipmaps
+            && header.encoding <= (uint32_t)TextureCompression::BC1
+            && header.width > 0 && header.height > 0 && header.channels >= 1 && header.channels <= 4
+            && header.levelCount >= 1 && header.levelCount <= 32;
+
+        if (valid) {
+            texture.width = header.width;
+            texture.height = header.height;
+            texture.channels = header.channels;
+            texture.compression = (TextureCompression)header.encoding;
+            texture.levels.resize(header.levelCount);
+            for (TextureLevel& level : texture.levels) {
+                LevelHeader levelHeader;
+                valid = fread(&levelHeader, sizeof(levelHeader), 1, file) == 1
+                    && levelHeader.width > 0 && levelHeader.height > 0
+                    && levelHeader.size == level_size(levelHeader.width, levelHeader.height, header.channels, texture.compression);
+                if (!valid)
+                    break;
+                level.width = levelHeader.width;
+                level.height = levelHeader.height;
+                level.data.resize(levelHeader.size);
+                valid = fread(level.data.data(), 1, level.data.size(), file) == level.data.size();
+                if (!valid)
+                    break;
+            }
+        }
+        fclose(file);
+
+        if (!valid)
+            texture = TextureData{};
+        return valid;
+    }
+
+    void write_cache(std::string const& cachePath, CacheHeader header, TextureData const& texture)
+    {
+        header.width = texture.width;
+        header.height = texture.height;
+        header.channels = texture.channels;
+        header.encoding = (uint32_t)texture.compression;
+        header.levelCount = (uint32_t)texture.levels.size();
+
+        // Written aside and renamed, so that an interrupted write never leaves a truncated cache
+        std::string partialPath = cachePath + ".partial";
+        FILE* file = fopen(partialPath.c_str(), "wb");
+        if (!file) {
+            printf("Texture cache: unable to write %s\n", cachePath.c_str());
+            return;
+        }
+        bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+        for (TextureLevel const& level : texture.levels) {
+            LevelHeader levelHeader{ level.width, level.height, level.data.size() };
+            success = success
+                && fwrite(&levelHeader, sizeof(levelHeader), 1, file) == 1
+                && fwrite(level.data.data(), 1, level.data.size(), file) == level.data.size();
+        }
+        success = fclose(file) == 0 && success;
+
+        std::error_code error;
+        if (success)
+            std::filesystem::rename(partialPath, cachePath, error);
+        if (!success || error) {
+            printf("Texture cache: unable to write %s\n", cachePath.c_str());
+            std::filesystem::remove(partialPath, error);
+        }
+    }
+
+    // Box filter of the 2x2 pixels under each pixel of the next level, the last row or column
+    // repeated for odd sizes
+    TextureLevel next_mip_level(TextureLevel const& level, int channels)
+    {
+        TextureLevel next;
+        next.width = std::max(1, level.width / 2);
+        next.height = std::max(1, level.height / 2);
+        next.data.resize((std::size_t)next.width * next.height * channels);
+
+        for (int y = 0; y < next.height; y++) {
+            int y0 = std::min(2 * y, level.height - 1), y1 = std::min(2 * y + 1, level.height - 1);
+            for (int x = 0; x < next.width; x++) {
+                int x0 = std::min(2 * x, level.width - 1), x1 = std::min(2 * x + 1, level.width - 1);
+                unsigned char const* p00 = &level.data[((std::size_t)y0 * level.width + x0) * channels];
+                unsigned char const* p01 = &level.data[((std::size_t)y0 * level.width + x1) * channels];
+                unsigned char const* p10 = &level.data[((std::size_t)y1 * level.width + x0) * channels];
+                unsigned char const* p11 = &level.data[((std::size_t)y1 * level.width + x1) * channels];
+                unsigned char* out = &next.data[((std::size_t)y * next.width + x) * channels];
+                for (int c = 0; c < channels; c++)
+                    out[c] = (unsigned char)((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+            }
+        }
+        return next;
+    }
+
+    uint16_t pack_565(float const color[3])
+    {
+        auto quantize = [](float value, int max) {
+            return (uint16_t)std::clamp((int)(value * max / 255.f + 0.5f), 0, max);
+        };
+        return (uint16_t)(quantize(color[0], 31) << 11 | quantize(color[1], 63) << 5 | quantize(color[2], 31));
+    }
+
+    void unpack_565(uint16_t packed, int color[3])
+    {
+        int r = packed >> 11 & 31, g = packed >> 5 & 63, b = packed & 31;
+        color[0] = r << 3 | r >> 2;
+        color[1] = g << 2 | g >> 4;
+        color[2] = b << 3 | b >> 2;
+    }
+
+    // The endpoints are the extremes of the pixels along their principal axis, every pixel then
+    // takes the nearest of the 4 colors between them
+    void encode_bc1_block(TextureLevel const& level, int channels, int blockX, int blockY, unsigned char* block)
+    {
+        float pixels[16][3];
+        float mean[3] = {};
+        for (int i = 0; i < 16; i++) {
+            int x = std::min(blockX + i % 4, level.width - 1);
+            int y = std::min(blockY + i / 4, level.height - 1);
+            unsigned char const* pixel = &level.data[((std::size_t)y * level.width + x) * channels];
+            for (int c = 0; c < 3; c++) {
+                pixels[i][c] = pixel[c];
+                mean[c] += pixel[c] / 16.f;
+            }
+        }
+
+        // Covariance: xx, xy, xz, yy, yz, zz
+        float covariance[6] = {};
+        for (auto const& pixel : pixels) {
+            float d[3] = { pixel[0] - mean[0], pixel[1] - mean[1], pixel[2] - mean[2] };
+            covariance[0] += d[0] * d[0]; covariance[1] += d[0] * d[1]; covariance[2] += d[0] * d[2];
+            covariance[3] += d[1] * d[1]; covariance[4] += d[1] * d[2]; covariance[5] += d[2] * d[2];
+        }
+
+        // Power iteration, a few steps are enough to pick the endpoints
+        float axis[3] = { 1.f, 1.f, 1.f };
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float next[3] = {
+                covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+                covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+                covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+            };
+            float largest = std::max({ std::abs(next[0]), std::abs(next[1]), std::abs(next[2]) });
+            if (largest == 0.f)
+                break;
+            for (int c = 0; c < 3; c++)
+                axis[c] = next[c] / largest;
+        }
+
+        float length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        float minT = 0.f, maxT = 0.f;
+        for (auto const& pixel : pixels) {
+            float t = ((pixel[0] - mean[0]) * axis[0] + (pixel[1] - mean[1]) * axis[1] + (pixel[2] - mean[2]) * axis[2]) / length2;
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        float end0[3], end1[3];
+        for (int c = 0; c < 3; c++) {
+            end0[c] = mean[c] + axis[c] * maxT;
+            end1[c] = mean[c] + axis[c] * minT;
+        }
+
+        // color0 > color1 selects the 4 color mode
+        uint16_t color0 = pack_565(end0), color1 = pack_565(end1);
+        if (color0 < color1)
+            std::swap(color0, color1);
+
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            int palette[4][3];
+            unpack_565(color0, palette[0]);
+            unpack_565(color1, palette[1]);
+            for (int c = 0; c < 3; c++) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; i++) {
+                int best = 0;
+                float bestDistance = 1e30f;
+                for (int p = 0; p < 4; p++) {
+                    float dr = pixels[i][0] - palette[p][0], dg = pixels[i][1] - palette[p][1], db = pixels[i][2] - palette[p][2];
+                    float distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= (uint32_t)best << (2 * i);
+            }
+        }
+
+        // Little endian, pixel 0 in the lowest bits
+        block[0] = (unsigned char)color0; block[1] = (unsigned char)(color0 >> 8);
+        block[2] = (unsigned char)color1; block[3] = (unsigned char)(color1 >> 8);
+        for (int i = 0; i < 4; i++)
+            block[4 + i] = (unsigned char)(indices >> (8 * i));
+    }
+
+    TextureLevel encode_bc1(TextureLevel const& level, int channels)
+    {
+        TextureLevel encoded;
+        encoded.width = level.width;
+        encoded.height = level.height;
+        encoded.data.resize(level_size(level.width, level.height, channels, TextureCompression::BC1));
+        unsigned char* block = encoded.data.data();
+        for (int y = 0; y < level.height; y += 4) {
+            for (int x = 0; x < level.width; x += 4, block += 8)
+                encode_bc1_block(level, channels, x, y, block);
+        }
+        return encoded;
+    }
+
+    GLenum pixel_format(int channels)
+    {
+        switch (channels) {
+        case 1: return GL_RED;
+        case 2: return GL_RG;
+        case 3: return GL_RGB;
+        default: return GL_RGBA;
+        }
+    }
+}
+
+TextureData load_texture_data(const char* path, bool mipmaps, TextureCompression compression)
+{
+    std::string cachePath = std::string(path) + ".texcache";
+
+    CacheHeader header{};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.compression = (uint32_t)compression;
+    header.mipmaps = mipmaps;
+    bool stamped = source_stamp(path, header.sourceSize, header.sourceTime);
+
+    TextureData texture;
+    if (stamped && read_cache(cachePath, header, texture))
+        return texture;
+
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(path, &width, &height, &channels, 0);
+    if (!pixels) {
+        printf("Texture failed to load at path: %s\n", path);
+        return texture;
+    }
+    texture.width = width;
+    texture.height = height;
+    texture.channels = channels;
+    texture.levels.push_back(TextureLevel{ width, height, std::vector<unsigned char>(pixels, pixels + (std::size_t)width * height * channels) });
+    stbi_image_free(pixels);
+
+    while (mipmaps && (texture.levels.back().width > 1 || texture.levels.back().height > 1))
+        texture.levels.push_back(next_mip_level(texture.levels.back(), channels));
+
+    // Compressed after the mip levels are generated from the exact pixels
+    if (compression == TextureCompression::BC1 && channels == 3) {
+        for (TextureLevel& level : texture.levels)
+            level = encode_bc1(level, channels);
+        texture.compression = TextureCompression::BC1;
+    }
+
+    if (stamped)
+        write_cache(cachePath, header, texture);
+    return texture;
+}
+
+bool texture_compression_supported(TextureCompression compression)
+{
+    if (compression == TextureCompression::None)
+        return true;
+
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && std::strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+            return true;
+    }
+    return false;
+}
+
+void upload_texture_data(GLenum target, TextureData const& texture)
+{
+    // Rows of the smaller levels are not 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GLenum format = pixel_format(texture.channels);
+    for (std::size_t i = 0; i < texture.levels.size(); i++) {
+        TextureLevel const& level = texture.levels[i];
+        if (texture.compression == TextureCompression::BC1)
+            glCompressedTexImage2D(target, (GLint)i, COMPRESSED_RGB_S3TC_DXT1, level.width, level.height, 0, (GLsizei)level.data.size(), level.data.data());
+        else
+            glTexImage2D(target, (GLint)i, format, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, level.data.data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
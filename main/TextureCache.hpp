@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glad.h>
+
+#include <vector>
+
+/**
+* @brief Block compression of a cached texture.
+*/
+enum class TextureCompression {
+	None,	// the decoded pixels
+	BC1		// S3TC DXT1, 8 bytes per 4x4 block, for RGB textures only (GL_EXT_texture_compression_s3tc)
+};
+
+/**
+* @brief One mip level of a texture: rows of pixels, or rows of 4x4 blocks when compressed, top row first.
+*/
+struct TextureLevel {
+	int width = 0, height = 0;
+	std::vector<unsigned char> data;
+};
+
+/**
+* @brief A decoded texture ready to be uploaded.
+*/
+struct TextureData {
+	int width = 0, height = 0, channels = 0;
+	TextureCompression compression = TextureCompression::None;
+	std::vector<TextureLevel> levels;	// level 0 first, empty if the texture failed to load
+};
+
+/**
+* @brief Loads a texture from its cache file, "<path>.texcache", if it is up to date: same size and
+* modification time of the source image, same mipmaps and compression. Otherwise decodes the source image
+* with stb_image, generates the mip levels, compresses them and writes the cache file for the next launches.
+* Does not touch GL, so it can run on any thread.
+*
+* @param path - The path to the source image.
+* @param mipmaps - Whether to generate the mip levels down to 1x1, rather than only level 0.
+* @param compression - The block compression, only applied to RGB images: the others, e.g. with
+* an alpha channel BC1 would drop, are cached uncompressed.
+*
+* @return The texture, without levels if it failed to load.
+*/
+TextureData load_texture_data(const char*, bool, TextureCompression);
+
+/**
+* @brief Whether the current GL context can sample the given compression. Needs the GL context.
+*
+* @param compression - The block compression.
+*
+* @return bool True if textures with this compression can be uploaded.
+*/
+bool texture_compression_supported(TextureCompression);
+
+/**
+* @brief Uploads every level of a texture to the bound texture object, with glCompressedTexImage2D
+* or glTexImage2D. Needs the GL context.
+*
+* @param target - The target of the image, e.g. GL_TEXTURE_2D or a cube map face.
+* @param texture - The texture.
+*
+* @return void
+*/
+void upload_texture_data(GLenum, TextureData const&);
@@ -0,0 +1,75 @@
+#include "VerletList.hpp"
+
+bool VerletList::isCurrent(std::vector<Boid> const& boids, uint32_t boidsRevision, SimulationBounds const& newBounds,
+    float newRadius, float skin, float movementSpeed) const
+{
+    if (!this->valid || boidsRevision != this->revision || newRadius != this->radius || this->reference.size() != boids.size())
+        return false;
+    if (newBounds.periodic != this->bounds.periodic)
+        return false;
+    for (int axis = 0; axis < 3; axis++) {
+        if (newBounds.min[axis] != this->bounds.min[axis] || newBounds.max[axis] != this->bounds.max[axis])
+            return false;
+    }
+
+    // Two boids have come closer by at most the sum of their displacements: 2 * the largest
+    // one since the rebuild, plus this tick's move for the boids updated earlier in the tick
+    float maxDisplacement2 = 0.f;
+    for (std::size_t i = 0; i < boids.size(); i++) {
+        Vec3f d = newBounds.displacement(this->reference[i], boids[i].currentPosition);
+        float d2 = dot(d, d);
+        if (d2 > maxDisplacement2)
+            maxDisplacement2 = d2;
+    }
+    return 2.f * std::sqrt(maxDisplacement2) + movementSpeed <= skin;
+}
+
+void VerletList::rebuild(std::vector<Boid> const& boids, float listRadius)
+{
+    std::size_t count = boids.size();
+    this->grid.build(this->bounds, listRadius, &boids.data()->currentPosition, count, sizeof(Boid));
+
+    this->start.resize(count + 1);
+    this->reference.resize(count);
+    this->candidates.clear();
+    float radius2 = listRadius * listRadius;
+    for (std::size_t i = 0; i < count; i++) {
+        Vec3f position = boids[i].currentPosition;
+        this->start[i] = (uint32_t)this->candidates.size();
+        this->reference[i] = position;
+        this->grid.forEachCandidate(position, listRadius, [&](uint32_t index) {
+            Vec3f d = this->bounds.displacement(position, boids[index].currentPosition);
+            if (index != i && dot(d, d) < radius2)
+                this->candidates.push_back(index);
+        });
+    }
+    this->start[count] = (uint32_t)this->candidates.size();
+}
+
+bool VerletList::prepare(std::vector<Boid> const& boids, uint32_t boidsRevision, SimulationBounds const& newBounds,
+    float visionRange, float skin, float movementSpeed)
+{
+    this->ticks++;
+
+    // Even fresh lists would miss boids that close the skin within this tick
+    if (movementSpeed > skin) {
+        this->fallbacks++;
+        this->valid = false;
+        return false;
+    }
+
+    float listRadius = visionRange + skin;
+    if (isCurrent(boids, boidsRevision, newBounds, listRadius, skin, movementSpeed)) {
+        this->ticksSinceRebuild++;
+        return true;
+    }
+
+    this->bounds = newBounds;
+    this->radius = listRadius;
+    this->revision = boidsRevision;
+    rebuild(boids, listRadius);
+    this->valid = true;
+    this->rebuilds++;
+    this->ticksSinceRebuild = 0;
+    return true;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Boid.hpp"
+#include "SimulationBounds.hpp"
+#include "SpatialGrid.hpp"
+
+/**
+* @brief Cached neighbour candidates of every boid (Verlet lists).
+* The candidates of a boid are the boids within visionRange + skin of it when the lists
+* were built. As long as no two boids have closed that skin since then, every neighbour
+* is still in the list and a tick only has to filter it, so the grid is rebuilt and
+* searched only when the boids have moved far enough.
+*/
+class VerletList {
+private:
+	std::vector<uint32_t> start;		// first candidate of each boid, with one extra end marker
+	std::vector<uint32_t> candidates;	// indices of the candidates, grouped by boid
+	std::vector<Vec3f> reference;		// positions of the boids when the lists were built
+	SpatialGrid grid;					// binned with the list radius, apart from the grid of the flock
+
+	// What the lists were built for; any change invalidates them
+	bool valid = false;
+	uint32_t revision = 0;
+	float radius = 0.f;
+	SimulationBounds bounds;
+
+	// Instrumentation
+	uint64_t ticks = 0;
+	uint64_t rebuilds = 0;
+	uint64_t fallbacks = 0;
+	uint64_t ticksSinceRebuild = 0;
+
+	/**
+	* @brief Checks if the cached lists still contain every neighbour for the coming tick.
+	*/
+	bool isCurrent(std::vector<Boid> const&, uint32_t, SimulationBounds const&, float, float, float) const;
+
+	/**
+	* @brief Rebuilds the candidate lists from the current positions.
+	*/
+	void rebuild(std::vector<Boid> const&, float);
+
+public:
+	/**
+	* @brief Makes the lists valid for the coming tick, rebuilding them only if a boid moved
+	* more than half the skin since the last rebuild (less half of this tick's move, which
+	* the boids updated earlier in the tick have already made), or if the boids, the
+	* bounds or the radius changed.
+	*
+	* @param boids - The boids, indexed by dense position.
+	* @param revision - The BoidPool revision of boids.
+	* @param bounds - The simulation space.
+	* @param visionRange - The radius of the neighbour search.
+	* @param skin - The extra radius of the candidate lists.
+	* @param movementSpeed - The distance a boid moves this tick.
+	*
+	* @return bool False if the skin is thinner than this tick's move, the lists cannot be
+	* used and the caller has to search the grid instead.
+	*/
+	bool prepare(std::vector<Boid> const&, uint32_t, SimulationBounds const&, float, float, float);
+
+	/**
+	* @brief Forgets the lists, e.g. when the mode is switched off.
+	*
+	* @return void
+	*/
+	void invalidate() {
+		this->valid = false;
+	}
+
+	/**
+	* @brief Pointer to the candidate indices of a boid.
+	*/
+	uint32_t const* candidatesOf(std::size_t index) const {
+		return this->candidates.data() + this->start[index];
+	}
+
+	/**
+	* @brief Number of candidates of a boid.
+	*/
+	std::size_t candidateCount(std::size_t index) const {
+		return this->start[index + 1] - this->start[index];
+	}
+
+	/**
+	* @brief Average number of candidates per boid in the current lists.
+	*/
+	float averageCandidates() const {
+		return this->reference.empty() ? 0.f : (float)this->candidates.size() / this->reference.size();
+	}
+
+	uint64_t tickCount() const {
+		return this->ticks;
+	}
+
+	uint64_t rebuildCount() const {
+		return this->rebuilds;
+	}
+
+	uint64_t fallbackCount() const {
+		return this->fallbacks;
+	}
+
+	uint64_t getTicksSinceRebuild() const {
+		return this->ticksSinceRebuild;
+	}
+
+	/**
+	* @brief Resets the instrumentation counters.
+	*
+	* @return void
+	*/
+	void resetStats() {
+		this->ticks = 0;
+		this->rebuilds = 0;
+		this->fallbacks = 0;
+	}
+};
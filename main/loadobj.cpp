@@ -4,7 +4,7 @@
 
 #include "../include/stb_image.h"
 
-Model load_wavefront_obj(char const* objPath) {
+MeshData load_wavefront_obj_data(char const* objPath) {
 	// Ask rapidobj to load the requested file
 	auto result = rapidobj::ParseFile(objPath);
 	if (result.error)
@@ -50,8 +50,9 @@ Model load_wavefront_obj(char const* objPath) {
 		}						
 	}
 
-	if (materials.size() > 0)
-		return Model(vertices, materials, materialIndexes);
-	else
-		return Model(vertices, materials.at(0));
+	return MeshData{ std::move(vertices), std::move(materials), std::move(materialIndexes) };
+}
+
+Model load_wavefront_obj(char const* objPath) {
+	return Model(load_wavefront_obj_data(objPath));
 }
@@ -2,6 +2,16 @@
 
 #include "Model.hpp"
 
+/**
+* @brief Uses rapidobj and .obj files to read a mesh made of triangles with vertices, normals and materials.
+* Does not touch GL, so it can run on any thread.
+*
+* @param objPath - The path for the .obj file.
+*
+* @return The mesh's vertices and materials.
+*/
+MeshData load_wavefront_obj_data(char const* objPath);
+
 /**
 * @brief Uses rapidobj and .obj files to create a mesh made of triangles with vertices, normals and material.
 *
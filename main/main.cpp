@@ -7,13 +7,28 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <memory>
+#include <string>
 
 #include "Cubemap.hpp"
 #include "Shader.hpp"
 #include "Model.hpp"
 #include "Boid.hpp"
+#include "Flock.hpp"
 #include "Obstacle.hpp"
+#include "SimulationBounds.hpp"
+#include "Profiler.hpp"
+#include "Benchmark.hpp"
+#include "GpuProfiler.hpp"
+#include "JobSystem.hpp"
+#include "AssetLoader.hpp"
+#include "SceneBatch.hpp"
+#include "FrameRecorder.hpp"
+#include "HeadlessContext.hpp"
 
 #include "Terrain.hpp"
 #include "Cone.hpp"
@@ -43,7 +58,26 @@ namespace {
     constexpr unsigned int FlY_THROUGH = 3;
     constexpr unsigned int THIRD_PERSON = 4;
 
-    constexpr Vec3f SIMULATION_SIZE = { 100.f, 50.f, 100.f };
+    // Half extents of the scenery (terrain, columns and rocks), modelled for the default bounds
+    constexpr Vec3f SCENE_SIZE = { 100.f, 50.f, 100.f };
+
+    // Time per frame given to creating the GL objects of the loaded assets
+    constexpr double UPLOAD_BUDGET_MS = 4.0;
+
+    // Boid matrices computed per job when filling the instance buffer
+    constexpr std::size_t TRANSFORMS_PER_JOB = 1024;
+
+    // Fish tail animation, wagged by the instanced vertex shaders: the shear at the peak of a wag,
+    // and the wags per second, faster for faster species
+    constexpr float TAIL_AMPLITUDE = 0.2f;
+    constexpr float TAIL_BASE_FREQUENCY = 0.25f;
+    constexpr float TAIL_FREQUENCY_PER_SPEED = 0.0125f;
+
+    // Passes of the static scene batch, each drawn in one call
+    constexpr std::size_t SCENE_TERRAIN = 0;
+    constexpr std::size_t SCENE_OBJECTS = 1;	// columns and rocks
+    constexpr std::size_t SCENE_HITBOXES = 2;	// obstacle bounding volumes, technical view only
+    constexpr std::size_t SCENE_PASSES = 3;
 
     constexpr unsigned int NO_DIRECTION = 0;
     constexpr unsigned int DIRECTION_GIVEN = 1;
@@ -52,17 +86,33 @@ namespace {
     // Global variables changeable in the GUI
     unsigned int boidControl = NO_DIRECTION;
 
-    float boidSpeed = 40.f;
-    float boidVisionRange = 12.f;
-    float boidVisionAngle = 150.f;
-
-    int boidsCount = 1000;
-
-    float cohesionStrength = 1.f;
-    float alignmentStrength = 1.f;
-    float separationStrength = 3.f;
+    // Per-species parameters and interaction matrix; the guidance and neighbour search
+    // fields are copied in from the globals below every tick
+    FlockSettings flockSettings;
+    int speciesCount = 1;
+    int editedSpecies = 0;
+    int boidsCount[MAX_SPECIES] = { 1000, 0, 0, 0 };
+
+    bool verletLists = false;
+    float verletSkin = 2.f;
+    int sortInterval = 60;
+
+    // Simulation volume; with constantDensity its horizontal extent grows with the boid count
+    SimulationBounds volumeBounds = {};
+    SimulationBounds simulationBounds = {};
+
+    // Number of boids of all the species in use
+    int totalBoidsCount() {
+        int total = 0;
+        for (int species = 0; species < speciesCount; species++)
+            total += boidsCount[species];
+        return total;
+    }
+    bool constantDensity = false;
+    float boidDensity = 1000.f / volumeBounds.volume();
 
-    unsigned int boidToFollow = 0;
+    BoidHandle boidToFollow = {};
+    bool pickBoidToFollow = false;
 
     // Options for the simulation
     bool paused = true;
@@ -105,13 +155,54 @@ namespace {
     bool rightClick = false;
     bool leftClick = false;
 
-    // Fish animation
-    float tailAngle = 0.f;
-    float tailSpeed = 0.01f;
+    // Fish animation: the phase of the tails of each species, in turns, to which every boid adds its own
+    float tailClock[MAX_SPECIES] = {};
+
+    // Offscreen rendering of an image sequence, set from the command line
+    struct OffscreenOptions {
+        int frames = 600;
+        int width = 1920;
+        int height = 1080;
+        float fps = 60.f;	// the simulation advances by 1 / fps per frame, however long the frame takes
+        FrameRecorder::Format format = FrameRecorder::Format::PNG;
+        std::string directory = "frames";
+    };
 }
 
 
-int main() {
+int main(int argc, char** argv) {
+    // Headless simulation benchmark, no window needed
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+        return runBenchmark(argc - 2, argv + 2);
+
+    // Image sequence rendered into a framebuffer object, also on machines without a display or GPU:
+    // main --offscreen [frames] [width] [height] [fps] [png|raw] [directory]
+    bool offscreen = argc > 1 && strcmp(argv[1], "--offscreen") == 0;
+    OffscreenOptions offscreenOptions;
+    if (offscreen) {
+        if (argc > 2) offscreenOptions.frames = atoi(argv[2]);
+        if (argc > 3) offscreenOptions.width = atoi(argv[3]);
+        if (argc > 4) offscreenOptions.height = atoi(argv[4]);
+        if (argc > 5) offscreenOptions.fps = (float)atof(argv[5]);
+        if (argc > 6 && strcmp(argv[6], "raw") == 0) offscreenOptions.format = FrameRecorder::Format::Raw;
+        if (argc > 7) offscreenOptions.directory = argv[7];
+        if (offscreenOptions.frames <= 0 || offscreenOptions.width <= 0 || offscreenOptions.height <= 0 || offscreenOptions.fps <= 0.f) {
+            printf("Usage: main --offscreen [frames] [width] [height] [fps] [png|raw] [directory]\n");
+            return 1;
+        }
+    }
+
+    // Start of the time to interactive
+    auto const startup = std::chrono::steady_clock::now();
+
+    // Offscreen, the context does not need a display if EGL can create one without it. GLFW then runs
+    // on its null platform, only for the window object the input and GUI code use; otherwise the
+    // frames are rendered with the context of a hidden window.
+    HeadlessContext headless;
+    bool headlessContext = offscreen && headless.create(4, 3);
+    if (headlessContext)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+
     // Initialize glfw
     if (!glfwInit()) {
         printf("Failed to initialize GLFW");
@@ -132,9 +223,14 @@ int main() {
 
     glfwWindowHint(GLFW_DEPTH_BITS, 24);
 
+    if (offscreen)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    if (headlessContext)
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+
     // Create the window
     GLFWwindow* window = glfwCreateWindow(
-        WINDOW_WIDTH, WINDOW_HEIGHT,
+        offscreen ? offscreenOptions.width : WINDOW_WIDTH, offscreen ? offscreenOptions.height : WINDOW_HEIGHT,
         "Boids-Simulation",
         nullptr, nullptr);
 
@@ -152,11 +248,13 @@ int main() {
     glfwSetCursorPosCallback(window, &cursor_position_callback);
     glfwSetMouseButtonCallback(window, &mouse_button_callback);
 
-    glfwMakeContextCurrent(window);
-    glfwSwapInterval(1);
+    if (!headlessContext) {
+        glfwMakeContextCurrent(window);
+        glfwSwapInterval(offscreen ? 0 : 1);
+    }
 
     // Load GLAD
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    if (!gladLoadGLLoader(headlessContext ? (GLADloadproc)HeadlessContext::getProcAddress : (GLADloadproc)glfwGetProcAddress)) {
         printf("Failed to load GLAD");
     }
     std::printf("RENDERER %s\n", glGetString(GL_RENDERER));
@@ -170,87 +268,192 @@ int main() {
     glEnable(GL_CULL_FACE);
     glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
 
+    // Offscreen, the frames are rendered into a framebuffer object and written by the recorder;
+    // the simulation runs from the start, without the GUI
+    std::unique_ptr<FrameRecorder> recorder;
+    if (offscreen) {
+        std::error_code error;
+        std::filesystem::create_directories(offscreenOptions.directory, error);
+        recorder = std::make_unique<FrameRecorder>(offscreenOptions.width, offscreenOptions.height,
+            offscreenOptions.directory, offscreenOptions.format);
+        if (!recorder->valid()) {
+            recorder.reset();
+            glfwTerminate();
+            return 1;
+        }
+        paused = false;
+        showGUI = false;
+    }
+
     // Initialize time for animations
     auto last = std::chrono::steady_clock::now();
     
-    // Set up shader for the skybox
-    Shader CubemapShader("assets/shaders/CubeMap.vert", "assets/shaders/CubeMap.frag");
-    const char* faces[6] = { "assets/textures/right.jpg",
-                            "assets/textures/left.jpg",
-                            "assets/textures/top.jpg",
-                            "assets/textures/bottom.jpg",
-                            "assets/textures/front.jpg",
-                            "assets/textures/back.jpg" };
-    Cubemap cubemap(faces);
-
-    // Set up shaders for model rendering
-    Shader SimpleShader("assets/shaders/BlinnPhongSimple.vert", "assets/shaders/BlinnPhongSimple.frag");
-    Shader MultiMaterialShader("assets/shaders/BlinnPhongMultiMat.vert", "assets/shaders/BlinnPhongMultiMat.frag");
-    GLuint shadersInUse[] = { SimpleShader.data.shaderProgram, MultiMaterialShader.data.shaderProgram };
-
     // ----------------------------- Define objects ----------------------------- //
 
-    // Terrain with material
-    Material terrainMat = Material{ rgb_to_linear(Vec3f{ 172, 150, 83 }), rgb_to_linear(Vec3f{ 189, 171, 117 }), rgb_to_linear(Vec3f{ 205, 192, 152 })};
-    Model terrain = generate_terrain("assets/textures/heightmap.png", terrainMat, make_scaling({ 0.0078f, 0.0005f, 0.0078f })); // Scaled to a 1 unit size
+    // Created on the context thread once their assets are decoded, see Load assets below;
+    // the render loop draws each of them as soon as it exists
+    std::unique_ptr<Shader> CubemapShader, SimpleShader, MultiMaterialShader, SimpleInstancedShader, MultiMaterialInstancedShader, BatchedShader;
+    GLuint shadersInUse[] = { 0, 0 };
+    GLuint instancedShadersInUse[] = { 0, 0 };
+    std::unique_ptr<Cubemap> cubemap;
+    std::unique_ptr<Model> terrain, box, sphere, columns, rocks, fish;
     float maxHeight = 0.f;
-    for (Vertex& v : terrain.vertices) {
-        if (v.positions.y > maxHeight) maxHeight = v.positions.y;
-    }
-    maxHeight = maxHeight * SIMULATION_SIZE.y;
 
+    // Terrain, columns, rocks and hitboxes, rebuilt when one of their meshes is loaded
+    SceneBatch scene(SCENE_PASSES);
+    bool sceneChanged = false;
 
-    // Obstacles meshes loaded from obj files
-    Model box = Model(load_wavefront_obj("assets/models/box.obj"));
-    Model sphere = Model(load_wavefront_obj("assets/models/sphere.obj"));
-    Model columns = Model(load_wavefront_obj("assets/models/AllColumns.obj"));
-    Model rocks = Model(load_wavefront_obj("assets/models/AllRocks.obj"));
-
-    // Abstract obstacle vector
+    // Abstract obstacle vector, the hitbox models are set once the box and sphere are loaded
     std::vector<Obstacle*> obstacles;
 
     // Columns on left side
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ -15.2f, 18.f, 5.f }, Vec3f{ 4.f, 24.f, 4.f }));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ -15.2f, 18.f, -25.f }, Vec3f{ 4.f, 24.f, 4.f }));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ -15.2f, 18.f, -55.f }, Vec3f{ 4.f, 24.f, 4.f }));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ -15.2f, 42.6f, -24.f }, Vec3f{ 4.f, 2.f, 38.f }));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ -15.2f, 0.f, 35.f }, Vec3f{ 4.f, 5.f, 4.f }));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ -15.2f, 4.f, 57.f }, Vec3f{ 4.f, 8.f, 4.f }));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ -15.2f, 0.1f, 49.9f }, Vec3f{ 4.f, 4.6f, 3.1f }));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ -9.f, -3.f, 44.f }, Vec3f{ 3.5f, 3.f, 12.f }));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ -15.2f, 18.f, 65.f }, Vec3f{ 4.f, 24.f, 4.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ -15.2f, 18.f, 5.f }, Vec3f{ 4.f, 24.f, 4.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ -15.2f, 18.f, -25.f }, Vec3f{ 4.f, 24.f, 4.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ -15.2f, 18.f, -55.f }, Vec3f{ 4.f, 24.f, 4.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ -15.2f, 42.6f, -24.f }, Vec3f{ 4.f, 2.f, 38.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ -15.2f, 0.f, 35.f }, Vec3f{ 4.f, 5.f, 4.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ -15.2f, 4.f, 57.f }, Vec3f{ 4.f, 8.f, 4.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ -15.2f, 0.1f, 49.9f }, Vec3f{ 4.f, 4.6f, 3.1f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ -9.f, -3.f, 44.f }, Vec3f{ 3.5f, 3.f, 12.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ -15.2f, 18.f, 65.f }, Vec3f{ 4.f, 24.f, 4.f }));
 
     // Columns on right side
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ 67.5f, 18.f, -55.f }, Vec3f{ 4.f, 24.f, 4.f }));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ 46.f, -2.5f, -26.f }, Vec3f{ 26.f, 4.f, 4.f }));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ 67.5f, 7.6f, 5.f }, Vec3f{ 4.f, 13.5f, 4.f }));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ 67.5f, 18.f, 35.f }, Vec3f{ 4.f, 24.f, 4.f }));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ 67.5f, 42.6f, 48.f }, Vec3f{ 4.f, 2.f, 23.f }));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ 67.5f, 17.f, 65.f }, Vec3f{ 4.f, 24.f, 4.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ 67.5f, 18.f, -55.f }, Vec3f{ 4.f, 24.f, 4.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ 46.f, -2.5f, -26.f }, Vec3f{ 26.f, 4.f, 4.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ 67.5f, 7.6f, 5.f }, Vec3f{ 4.f, 13.5f, 4.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ 67.5f, 18.f, 35.f }, Vec3f{ 4.f, 24.f, 4.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ 67.5f, 42.6f, 48.f }, Vec3f{ 4.f, 2.f, 23.f }));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ 67.5f, 17.f, 65.f }, Vec3f{ 4.f, 24.f, 4.f }));
 
     // statue in the middle
-    obstacles.push_back(new SphereObstacle(&sphere, Vec3f{ 26.5f, 1.f, -56.f }, 9.f));
+    obstacles.push_back(new SphereObstacle(nullptr, Vec3f{ 26.5f, 1.f, -56.f }, 9.f));
     
     // rocks
-    obstacles.push_back(new SphereObstacle(&sphere, Vec3f{ -60.f, -8.f, -58.f }, 35.f));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ -62.8f, 2.4f, -20.f }, Vec3f{ 7.f, 9.f, 10.f }));
-    obstacles.push_back(new SphereObstacle(&sphere, Vec3f{ -68.f, -8.7f, 40.f }, 29.f));
-    obstacles.push_back(new BoxObstacle(&box, Vec3f{ -60.9f, -2.3f, 10.f }, Vec3f{ 9.3f, 3.7f, 7.f }));
+    obstacles.push_back(new SphereObstacle(nullptr, Vec3f{ -60.f, -8.f, -58.f }, 35.f));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ -62.8f, 2.4f, -20.f }, Vec3f{ 7.f, 9.f, 10.f }));
+    obstacles.push_back(new SphereObstacle(nullptr, Vec3f{ -68.f, -8.7f, 40.f }, 29.f));
+    obstacles.push_back(new BoxObstacle(nullptr, Vec3f{ -60.9f, -2.3f, 10.f }, Vec3f{ 9.3f, 3.7f, 7.f }));
+
+
+    // ------------------------------ Load assets ------------------------------- //
+
+    // Skybox faces and terrain material
+    const char* faces[6] = { "assets/textures/right.jpg",
+                            "assets/textures/left.jpg",
+                            "assets/textures/top.jpg",
+                            "assets/textures/bottom.jpg",
+                            "assets/textures/front.jpg",
+                            "assets/textures/back.jpg" };
+    CubemapFace cubemapFaces[6];
+    Material terrainMat = Material{ rgb_to_linear(Vec3f{ 172, 150, 83 }), rgb_to_linear(Vec3f{ 189, 171, 117 }), rgb_to_linear(Vec3f{ 205, 192, 152 })};
 
+    // Every asset is read and decoded by a job; its GL objects are created by the render loop
+    // between frames. Declared after what the jobs write into, so it waits for them on exit.
+    JobSystem& jobs = JobSystem::get();
+    AssetLoader assets;
+
+    // Shaders for the skybox and for model rendering, the instanced ones read model2world per instance
+    assets.load([&]() -> AssetLoader::Upload {
+        Shader::Sources sources[] = {
+            Shader::read("assets/shaders/CubeMap.vert", "assets/shaders/CubeMap.frag"),
+            Shader::read("assets/shaders/BlinnPhongSimple.vert", "assets/shaders/BlinnPhongSimple.frag"),
+            Shader::read("assets/shaders/BlinnPhongMultiMat.vert", "assets/shaders/BlinnPhongMultiMat.frag"),
+            Shader::read("assets/shaders/BlinnPhongSimpleInstanced.vert", "assets/shaders/BlinnPhongSimple.frag"),
+            Shader::read("assets/shaders/BlinnPhongMultiMatInstanced.vert", "assets/shaders/BlinnPhongMultiMat.frag"),
+            Shader::read("assets/shaders/BlinnPhongBatched.vert", "assets/shaders/BlinnPhongMultiMat.frag"),
+        };
+        return [&, sources]() {
+            CubemapShader = std::make_unique<Shader>(sources[0]);
+            SimpleShader = std::make_unique<Shader>(sources[1]);
+            MultiMaterialShader = std::make_unique<Shader>(sources[2]);
+            SimpleInstancedShader = std::make_unique<Shader>(sources[3]);
+            MultiMaterialInstancedShader = std::make_unique<Shader>(sources[4]);
+            BatchedShader = std::make_unique<Shader>(sources[5]);
+            shadersInUse[0] = SimpleShader->data.shaderProgram;
+            shadersInUse[1] = MultiMaterialShader->data.shaderProgram;
+            instancedShadersInUse[0] = SimpleInstancedShader->data.shaderProgram;
+            instancedShadersInUse[1] = MultiMaterialInstancedShader->data.shaderProgram;
+        };
+    });
+
+    // Skybox, its 6 faces loaded in parallel in the background, block compressed if the GPU samples BC1
+    TextureCompression skyboxCompression = texture_compression_supported(TextureCompression::BC1)
+        ? TextureCompression::BC1 : TextureCompression::None;
+    std::vector<JobSystem::JobHandle> faceDecodes;
+    for (int i = 0; i < 6; i++)
+        faceDecodes.push_back(jobs.submit([&cubemapFaces, &faces, i, skyboxCompression]() { cubemapFaces[i] = load_cubemap_face(faces[i], skyboxCompression); },
+            {}, JobSystem::Queue::Background));
+    assets.load([&]() -> AssetLoader::Upload {
+        return [&]() { cubemap = std::make_unique<Cubemap>(cubemapFaces); };
+    }, faceDecodes);
+
+    // Terrain
+    assets.load([&]() -> AssetLoader::Upload {
+        MeshData mesh = generate_terrain_data("assets/textures/heightmap.png", terrainMat, make_scaling({ 0.0078f, 0.0005f, 0.0078f })); // Scaled to a 1 unit size
+        float height = 0.f;
+        for (Vertex& v : mesh.vertices) {
+            if (v.positions.y > height) height = v.positions.y;
+        }
+        return [&, mesh = std::move(mesh), height]() mutable {
+            terrain = std::make_unique<Model>(std::move(mesh));
+            maxHeight = height * SCENE_SIZE.y;
+            terrain->model2world = make_translation({ 0.f, -maxHeight, 0.f }) * make_scaling(SCENE_SIZE);
+            sceneChanged = true;
+        };
+    });
+
+    // Obstacles meshes loaded from obj files, the box and sphere also draw the hitboxes
+    assets.load([&]() -> AssetLoader::Upload {
+        MeshData mesh = load_wavefront_obj_data("assets/models/box.obj");
+        return [&, mesh = std::move(mesh)]() mutable {
+            box = std::make_unique<Model>(std::move(mesh));
+            for (Obstacle* obstacle : obstacles) {
+                if (dynamic_cast<BoxObstacle*>(obstacle))
+                    obstacle->model = box.get();
+            }
+            sceneChanged = true;
+        };
+    });
+    assets.load([&]() -> AssetLoader::Upload {
+        MeshData mesh = load_wavefront_obj_data("assets/models/sphere.obj");
+        return [&, mesh = std::move(mesh)]() mutable {
+            sphere = std::make_unique<Model>(std::move(mesh));
+            for (Obstacle* obstacle : obstacles) {
+                if (dynamic_cast<SphereObstacle*>(obstacle))
+                    obstacle->model = sphere.get();
+            }
+            sceneChanged = true;
+        };
+    });
+    assets.load([&]() -> AssetLoader::Upload {
+        MeshData mesh = load_wavefront_obj_data("assets/models/AllColumns.obj");
+        return [&, mesh = std::move(mesh)]() mutable {
+            columns = std::make_unique<Model>(std::move(mesh));
+            sceneChanged = true;
+        };
+    });
+    assets.load([&]() -> AssetLoader::Upload {
+        MeshData mesh = load_wavefront_obj_data("assets/models/AllRocks.obj");
+        return [&, mesh = std::move(mesh)]() mutable {
+            rocks = std::make_unique<Model>(std::move(mesh));
+            sceneChanged = true;
+        };
+    });
 
     // Fish mesh loaded from obj files
-    Model fish = load_wavefront_obj("assets/models/fish.obj");
-    
+    assets.load([&]() -> AssetLoader::Upload {
+        MeshData mesh = load_wavefront_obj_data("assets/models/fish.obj");
+        return [&, mesh = std::move(mesh)]() mutable { fish = std::make_unique<Model>(std::move(mesh)); };
+    });
+
     // Cone mesh to represent the boids in technical view
     Model cone = generate_cone(16, {}, make_scaling({ 3.f, 1.f, 1.f }));
 
-    // Initialize a number of boidsCount boids
-    std::vector<Boid*> boids;
+    // Initialize boidsCount boids of every species
+    Flock flock(simulationBounds);
     srand((unsigned int)(time(NULL)));
-    for (int i = 0; i < boidsCount; i++)
-    {
-	    boids.push_back(new Boid(obstacles));
-    }
+    for (uint32_t species = 0; species < MAX_SPECIES; species++)
+        flock.resize(species, (int)species < speciesCount ? boidsCount[species] : 0, obstacles);
 
     //ImGUI setup
     IMGUI_CHECKVERSION();
@@ -260,52 +463,92 @@ int main() {
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 430");
 
-    // Rules initialization for the boids
-    Vec3f cohesion = { 0.f, 0.f, 0.f };
-    Vec3f alignment = { 0.f, 0.f, 0.f };
-    Vec3f separation = { 0.f, 0.f, 0.f };
-    Vec3f avoid = { 0.f, 0.f, 0.f };
+    // GPU timer queries for the profiler panel
+    GpuProfiler::get().init();
+
+    // Startup times reported once, in ms since main started
+    double firstFrameMs = 0.0, interactiveMs = 0.0;
+
+    // The recorded frames show the whole scene from the first one
+    if (recorder)
+        assets.loadAll();
 
     // Start the rendering loop
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
 
-        // Update number of boids if changed by the GUI
-        while ((unsigned int)boidsCount > boids.size()) {
-            boids.push_back(new Boid(obstacles));
+        // Create the GL objects of the assets decoded since the last frame
+        if (!assets.finished())
+            assets.pumpUploads(UPLOAD_BUDGET_MS);
+
+        // Batch the static meshes loaded so far
+        if (sceneChanged) {
+            scene.clear();
+            if (terrain)
+                scene.add(SCENE_TERRAIN, *terrain, terrain->model2world);
+            if (columns)
+                scene.add(SCENE_OBJECTS, *columns, columns->model2world);
+            if (rocks)
+                scene.add(SCENE_OBJECTS, *rocks, rocks->model2world);
+            for (Obstacle* obstacle : obstacles) {
+                if (obstacle->model)
+                    scene.add(SCENE_HITBOXES, *obstacle->model, obstacle->model2world);
+            }
+            scene.upload();
+            sceneChanged = false;
         }
 
-        // If the number of boids is decreased, delete the last boids
-        while ((unsigned int)boidsCount < boids.size()) {
-            boids.pop_back();
+        // Update the simulation volume and the number of boids if changed by the GUI
+        if (constantDensity)
+            simulationBounds = SimulationBounds::withDensity(volumeBounds, totalBoidsCount(), boidDensity);
+        else
+            simulationBounds = volumeBounds;
+        flock.setBounds(simulationBounds);
+        for (uint32_t species = 0; species < MAX_SPECIES; species++)
+            flock.resize(species, (int)species < speciesCount ? boidsCount[species] : 0, obstacles);
+
+        // Pick a random boid when switching to the third person camera
+        if (pickBoidToFollow) {
+            if (flock.size() > 0)
+                boidToFollow = flock.handleAt(rand() % flock.size());
+            pickBoidToFollow = false;
         }
 
         // If the user is using the third person camera and the number of boids is decreased, 
         // deleting the currently viewed boid defaults to the first boid or to the locked arc 
         // ball camera if there is no boid left
-        if (boids.size() == 0 && camera.mode == THIRD_PERSON) {
+        if (flock.size() == 0 && camera.mode == THIRD_PERSON) {
             camera.mode = LOCKED_ARC_BALL;
             camera.position.z = 150.f;
-            boidToFollow = 0;
+            boidToFollow = {};
         }
-        else if(boids.size() > 0 && boidToFollow > boids.size()) boidToFollow = 0;
+        else if(flock.size() > 0 && flock.get(boidToFollow) == nullptr) boidToFollow = flock.handleAt(0);
 
-        // Set viewport to current window size
+        // Set viewport to current window size, or to the size of the recorded frames
         int nwidth, nheight;
-        glfwGetFramebufferSize(window, &nwidth, &nheight);
-
-        // if the window is minimized, wait for it to be restored
-        while (0 == nwidth || 0 == nheight) {
-            glfwWaitEvents();
+        if (recorder) {
+            recorder->bind();
+            nwidth = offscreenOptions.width;
+            nheight = offscreenOptions.height;
+        }
+        else {
             glfwGetFramebufferSize(window, &nwidth, &nheight);
+
+            // if the window is minimized, wait for it to be restored
+            while (0 == nwidth || 0 == nheight) {
+                glfwWaitEvents();
+                glfwGetFramebufferSize(window, &nwidth, &nheight);
+            }
         }
 
         glViewport(0, 0, nwidth, nheight);
 
-        // Update time dt between frames
+        // Update time dt between frames, fixed when recording
         auto const now = std::chrono::steady_clock::now();
         float dt = std::chrono::duration_cast<std::chrono::duration<float, std::ratio<1>>>(now - last).count();
         last = now;
+        if (recorder)
+            dt = 1.f / offscreenOptions.fps;
 
         // Camera movement
         float measurmentUnit = CAMERA_MOVEMENT * dt * camera.move.speed;
@@ -361,7 +604,7 @@ int main() {
         else if (camera.mode == THIRD_PERSON)
         {
             // Translate camera to boid's current position
-            Mat44f T1 = make_translation(-boids.at(boidToFollow)->currentPosition);
+            Mat44f T1 = make_translation(-flock.get(boidToFollow)->currentPosition);
 
             // Rotate camera around the object and translate from/to it to zoom
             Mat44f Rx = make_rotation_x(camera.rotation.y);
@@ -382,6 +625,7 @@ int main() {
 
         // ImGui setup for the GUI
         {
+            PROFILE_SCOPE(ProfileStage::GUI);
             ImGui_ImplOpenGL3_NewFrame();
             ImGui_ImplGlfw_NewFrame();
             ImGui::NewFrame();
@@ -397,27 +641,120 @@ int main() {
             ImGui::SameLine();
             ImGui::Checkbox("Technical View [T]", &technicalView);
             ImGui::Checkbox("Switch GUI on/off [G]", &showGUI);
+            if (!assets.finished())
+                ImGui::Text("Loading assets: %zu of %zu", assets.loadedCount(), assets.assetCount());
             if (ImGui::CollapsingHeader("Boid settings", ImGuiTreeNodeFlags_DefaultOpen)) {
-                ImGui::SliderInt("Boid Count", &boidsCount, 0, 3000);
-                ImGui::SliderFloat("Boid Speed", &boidSpeed, 0.f, 100.f);
-                ImGui::SliderFloat("Boid Vision Range", &boidVisionRange, 0.f, 15.f);
-                ImGui::SliderFloat("Boid Vision Angle", &boidVisionAngle, 0.f, 180.f);
+                ImGui::SliderInt("Species", &speciesCount, 1, (int)MAX_SPECIES);
+                if (editedSpecies >= speciesCount)
+                    editedSpecies = speciesCount - 1;
+                if (speciesCount > 1)
+                    ImGui::SliderInt("Edited species", &editedSpecies, 0, speciesCount - 1);
+                SpeciesSettings& species = flockSettings.species[editedSpecies];
+                ImGui::SliderInt("Boid Count", &boidsCount[editedSpecies], 0, 20000);
+                ImGui::SliderFloat("Boid Speed", &species.speed, 0.f, 100.f);
+                ImGui::SliderFloat("Boid Vision Range", &species.visionRange, 0.f, 15.f);
+                ImGui::SliderFloat("Boid Vision Angle", &species.visionAngle, 0.f, 180.f);
+                ImGui::Checkbox("Verlet neighbour lists", &verletLists);
+                if (verletLists) {
+                    VerletList& verlet = flock.verletList(editedSpecies);
+                    ImGui::SliderFloat("Verlet skin", &verletSkin, 0.1f, 10.f);
+                    float rebuildRate = verlet.tickCount() > 0 ? 100.f * verlet.rebuildCount() / verlet.tickCount() : 0.f;
+                    ImGui::Text("Rebuilds: %llu of %llu ticks (%.1f%%), last %llu ticks ago",
+                        (unsigned long long)verlet.rebuildCount(), (unsigned long long)verlet.tickCount(), rebuildRate,
+                        (unsigned long long)verlet.getTicksSinceRebuild());
+                    ImGui::Text("Skin thinner than a tick's move: %llu ticks", (unsigned long long)verlet.fallbackCount());
+                    ImGui::Text("%.1f candidates per boid", verlet.averageCandidates());
+                    if (ImGui::Button("Reset Verlet stats"))
+                        verlet.resetStats();
+                }
+                ImGui::SliderInt("Morton sort interval (ticks, 0 = off)", &sortInterval, 0, 240);
+                ImGui::Checkbox("Topological neighbours (k nearest)", &flockSettings.topological);
+                if (flockSettings.topological)
+                    ImGui::SliderInt("Neighbours per boid", &flockSettings.topologicalNeighbours, 1, 32);
+                ImGui::Checkbox("Approximate neighbour search (experimental, slower)", &flockSettings.approximate);
+                if (flockSettings.approximate)
+                    ImGui::SliderFloat("Opening angle (0 = exact)", &flockSettings.openingAngle, 0.f, 2.f);
                 if (ImGui::Button("Default parameters")) {
-                    boidSpeed = 40.f;
-                    boidVisionRange = 12.f;
-                    boidVisionAngle = 150.f;
-                    boidsCount = 1000;
+                    SpeciesSettings defaults;
+                    species.speed = defaults.speed;
+                    species.visionRange = defaults.visionRange;
+                    species.visionAngle = defaults.visionAngle;
+                    boidsCount[editedSpecies] = 1000;
                 }
                 ImGui::Separator();
                 ImGui::Text("Rules:");
-                ImGui::SliderFloat("Cohesion", &cohesionStrength, 0.f, 5.f);
-                ImGui::SliderFloat("Alignment", &alignmentStrength, 0.f, 5.f);
-                ImGui::SliderFloat("Separation", &separationStrength, 0.f, 5.f);
+                ImGui::SliderFloat("Cohesion", &species.cohesion, 0.f, 5.f);
+                ImGui::SliderFloat("Alignment", &species.alignment, 0.f, 5.f);
+                ImGui::SliderFloat("Separation", &species.separation, 0.f, 5.f);
+                ImGui::SliderFloat("Edge avoidance", &species.edgeAvoidance, 0.f, 5.f);
+                ImGui::SliderFloat("Obstacle avoidance", &species.obstacleAvoidance, 0.f, 5.f);
+                if (speciesCount > 1) {
+                    // Predators are fled by the other species; they chase them through the interaction matrix
+                    ImGui::Checkbox("Predator", &species.predator);
+                    if (!species.predator) {
+                        ImGui::SliderFloat("Flee", &species.flee, 0.f, 10.f);
+                        ImGui::SliderFloat("Fear radius", &species.fearRadius, 0.f, 60.f);
+                    }
+                }
                 if (ImGui::Button("Default rule strengths")) {
-                    cohesionStrength = 1.f;
-                    alignmentStrength = 1.f;
-                    separationStrength = 3.f;
+                    SpeciesSettings defaults;
+                    species.cohesion = defaults.cohesion;
+                    species.alignment = defaults.alignment;
+                    species.separation = defaults.separation;
+                    species.edgeAvoidance = defaults.edgeAvoidance;
+                    species.obstacleAvoidance = defaults.obstacleAvoidance;
+                    species.flee = defaults.flee;
+                }
+                // Rules set to 0 are compiled out of the specialised pipeline picked for the tick
+                ImGui::Text("Rule pipeline: 0x%02X", flock.activeRuleMask(editedSpecies));
+                if (speciesCount > 1) {
+                    // Row of the interaction matrix: how much the rules of this species weigh each species
+                    ImGui::Text("Interactions (negative = repulsion):");
+                    for (int other = 0; other < speciesCount; other++) {
+                        ImGui::PushID(other);
+                        char label[32];
+                        snprintf(label, sizeof(label), "With species %d", other);
+                        ImGui::SliderFloat(label, &flockSettings.interaction[editedSpecies][other], -2.f, 2.f);
+                        ImGui::PopID();
+                    }
+                }
+                ImGui::Separator();
+            }
+            if (ImGui::CollapsingHeader("Simulation volume")) {
+                Vec3f size = volumeBounds.size();
+                bool changed = ImGui::SliderFloat("Width (X)", &size.x, 20.f, 2000.f);
+                changed |= ImGui::SliderFloat("Height (Y)", &size.y, 10.f, 500.f);
+                changed |= ImGui::SliderFloat("Depth (Z)", &size.z, 20.f, 2000.f);
+                if (changed) {
+                    volumeBounds.min = Vec3f{ -size.x / 2.f, 0.f, -size.z / 2.f };
+                    volumeBounds.max = Vec3f{ size.x / 2.f, size.y, size.z / 2.f };
                 }
+                ImGui::Checkbox("Periodic boundaries (wrap around)", &volumeBounds.periodic);
+                ImGui::Checkbox("Keep density constant", &constantDensity);
+                if (constantDensity) {
+                    float boidsPer1000 = boidDensity * 1000.f;
+                    if (ImGui::SliderFloat("Boids per 1000 units^3", &boidsPer1000, 0.01f, 10.f, "%.3f", ImGuiSliderFlags_Logarithmic))
+                        boidDensity = boidsPer1000 / 1000.f;
+                }
+                Vec3f actual = simulationBounds.size();
+                ImGui::Text("Volume %.0f x %.0f x %.0f, %.3f boids per 1000 units^3", actual.x, actual.y, actual.z,
+                    totalBoidsCount() / simulationBounds.volume() * 1000.f);
+                if (ImGui::Button("Default volume")) {
+                    volumeBounds = SimulationBounds{};
+                    constantDensity = false;
+                    boidDensity = 1000.f / volumeBounds.volume();
+                }
+                ImGui::Separator();
+            }
+            if (ImGui::CollapsingHeader("Profiler")) {
+                Profiler::get().drawGui();
+                ImGui::Separator();
+                GpuProfiler::get().drawGui();
+                ImGui::Separator();
+                std::size_t arenaUsed, arenaReserved;
+                Arena::totals(arenaUsed, arenaReserved);
+                ImGui::Text("Tick arenas: %.1f KB used / %.1f KB reserved", arenaUsed / 1024.f, arenaReserved / 1024.f);
+                ImGui::Text("Startup: first frame %.1f ms, interactive %.1f ms", firstFrameMs, interactiveMs);
                 ImGui::Separator();
             }
             if (ImGui::CollapsingHeader("Camera controls (Instructions)", false)) {
@@ -505,9 +842,9 @@ int main() {
                 ImGui::Text("To move the target point, use these sliders or:");
                 ImGui::Text("Hold [LEFT CLICK] to move it on the Y axis.");
                 ImGui::Text("Hold [RIGHT CLICK] to move on the XZ plane.");
-                ImGui::SliderFloat("Point X", &userInputLocation.x, -SIMULATION_SIZE.x, SIMULATION_SIZE.x);
-                ImGui::SliderFloat("Point Y", &userInputLocation.y, 0.f, SIMULATION_SIZE.y);
-                ImGui::SliderFloat("Point Z", &userInputLocation.z, -SIMULATION_SIZE.z, SIMULATION_SIZE.z);
+                ImGui::SliderFloat("Point X", &userInputLocation.x, simulationBounds.min.x, simulationBounds.max.x);
+                ImGui::SliderFloat("Point Y", &userInputLocation.y, simulationBounds.min.y, simulationBounds.max.y);
+                ImGui::SliderFloat("Point Z", &userInputLocation.z, simulationBounds.min.z, simulationBounds.max.z);
                 if (ImGui::Button("Default target (Origin)")) {
                     userInputLocation = { 0.f, 0.f, 0.f };
                 }
@@ -526,95 +863,153 @@ int main() {
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // set terrain transforms
-        terrain.model2world = make_translation({ 0.f, -maxHeight, 0.f }) * make_scaling(SIMULATION_SIZE);
-
-        // Simulation parameters
-        float movementSpeed = dt * boidSpeed;
-        float turnSharpness = movementSpeed * 0.2f;
-
-        // If the simulation is running, animate the boids
+        // If the simulation is running, animate the boids. The phase is integrated rather than
+        // computed from the time so that changing the speed does not make the tails jump.
         if (!technicalView && !paused) {
-            tailAngle += tailSpeed;
-            if (tailAngle >= 0.2f || tailAngle <= -0.2f) tailSpeed = -tailSpeed;
+            for (uint32_t species = 0; species < MAX_SPECIES; species++) {
+                float frequency = TAIL_BASE_FREQUENCY + TAIL_FREQUENCY_PER_SPEED * flockSettings.species[species].speed;
+                tailClock[species] = std::fmod(tailClock[species] + frequency * dt, 1.f);
+            }
         }
 
         // Apply boids algorithm
-        for (auto boid : boids) {
-            if (!paused) {
-                std::vector<Boid*> neighbours = boid->findNeighbours(boids, boidVisionRange, boidVisionAngle);
-                cohesion = boid->applyCohesion(neighbours, cohesionStrength);
-                alignment = boid->applyAlignment(neighbours, alignmentStrength);
-                separation = boid->applySeparation(neighbours, separationStrength, boidVisionRange);
-                avoid = boid->avoidEdges(2.f) + boid->avoidObstacles(obstacles, 3.f);
-
-                if (boidControl == POINT_GIVEN) {
-                    userInputDirection = normalize(userInputLocation - boid->currentPosition);
+        if (!paused) {
+            FlockSettings& settings = flockSettings;
+            settings.verletLists = verletLists;
+            settings.verletSkin = verletSkin;
+            settings.sortInterval = sortInterval;
+            settings.targetDirection = userInputDirection;
+            settings.followTargetPoint = boidControl == POINT_GIVEN;
+            settings.targetPoint = userInputLocation;
+            flock.update(dt, settings, obstacles);
+        }
+
+        // Render boids with the animated fish model or the cone (technical view)
+        {
+            PROFILE_SCOPE(ProfileStage::BoidRender);
+            GpuPassScope gpuPass(GpuPass::Boids);
+            // All the boids are drawn with one instanced draw call, the vertex shader wags their tails.
+            // The jobs write the matrices straight into the instance buffer, mapped for the GPU.
+            Model* boidModel = technicalView ? &cone : fish.get();
+            if (boidModel && SimpleInstancedShader && flock.size() > 0) {
+                InstanceData* instances = boidModel->mapInstances(flock.size());
+                float tailAmplitude = technicalView ? 0.f : TAIL_AMPLITUDE;
+                for (uint32_t species = 0; species < MAX_SPECIES; species++) {
+                    std::vector<Boid> const& all = flock.pool(species).all();
+                    float clock = tailClock[species];
+                    jobs.parallelFor(all.size(), TRANSFORMS_PER_JOB, [&](std::size_t begin, std::size_t end) {
+                        make_model_matrices(&all[begin].currentPosition, &all[begin].currentDirection, end - begin,
+                            0.f, &instances[begin].model2world, sizeof(Boid), sizeof(InstanceData));
+                        for (std::size_t i = begin; i < end; i++) {
+                            instances[i].tailPhase = all[i].tailPhase + clock;
+                            instances[i].tailAmplitude = tailAmplitude;
+                        }
+                    });
+                    instances += all.size();
                 }
+                boidModel->renderInstanced(camera.position, light, world2projection, flock.size(), instancedShadersInUse);
+            }
+        }
 
-                boid->setTargetDirection(normalize(boid->currentDirection +
-                    cohesion + alignment + separation + userInputDirection) + avoid);
-                boid->updateDirection(movementSpeed, turnSharpness);
+        // The scenery is drawn piece by piece while it is loading
+        if (SimpleShader) {
+            PROFILE_SCOPE(ProfileStage::SceneRender);
+
+            // Render terrain (as wireframe if in technical view mode)
+            {
+                GpuPassScope gpuPass(GpuPass::Terrain);
+                if(technicalView)
+                    gl_state_change(glPolygonMode, GL_FRONT_AND_BACK, GL_LINE);
+                scene.render(SCENE_TERRAIN, camera.position, light, world2projection, BatchedShader->data.shaderProgram);
+                gl_state_change(glPolygonMode, GL_FRONT_AND_BACK, GL_FILL);
             }
-            // Render boids with the animated fish model or the cone (technical view)
-            if (!technicalView) {
-                Mat44f animation = make_shear_x(0.f, tailAngle);
-                fish.render(camera.position, light, world2projection, boid->model2world*animation, shadersInUse);
+
+            {
+                GpuPassScope gpuPass(GpuPass::Obstacles);
+
+                // Render obstacles: columns and rocks
+                scene.render(SCENE_OBJECTS, camera.position, light, world2projection, BatchedShader->data.shaderProgram);
+
+                // Render red sphere at the target point given by the user
+                if(boidControl == POINT_GIVEN && sphere)
+                    sphere->render(camera.position, light, world2projection, make_translation(userInputLocation), shadersInUse);
+
+                // Render obstacle hitboxes (bounding volumes) if in technical view mode
+                if (technicalView) {
+                    gl_state_change(glEnable, GL_BLEND);
+                    gl_state_change(glBlendFunc, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                    scene.render(SCENE_HITBOXES, camera.position, light, world2projection, BatchedShader->data.shaderProgram);
+                    gl_state_change(glDisable, GL_BLEND);
+                }
             }
-            else
-                cone.render(camera.position, light, world2projection, boid->model2world, shadersInUse);
-        }
 
-        // Render terrain (as wireframe if in technical view mode)
-        if(technicalView)
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        terrain.render(camera.position, light, world2projection, terrain.model2world, shadersInUse);
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-        // Render obstacles: columns and rocks
-        columns.render(camera.position, light, world2projection, columns.model2world, shadersInUse);
-        rocks.render(camera.position, light, world2projection, rocks.model2world, shadersInUse);
-
-        // Render red sphere at the target point given by the user
-        if(boidControl == POINT_GIVEN)
-            sphere.render(camera.position, light, world2projection, make_translation(userInputLocation), shadersInUse);
-
-        // Render obstacle hitboxes (bounding volumes) if in technical view mode
-        if (technicalView) {
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            for (auto obstacle : obstacles) {
-                if(obstacle->model)
-                    obstacle->model->render(camera.position, light, world2projection, obstacle->model2world, shadersInUse);
-		    }
-            glDisable(GL_BLEND);
+            // Render cubemap if not in technical view mode
+            if (!technicalView && cubemap) {
+                GpuPassScope gpuPass(GpuPass::Cubemap);
+                cubemap->render(projection, world2camera, CubemapShader->data.shaderProgram);
+            }
         }
-        else // Render cubemap if not in technical view mode
-            cubemap.render(projection, world2camera, CubemapShader.data.shaderProgram);
 
-        glBindVertexArray(0);
-        glUseProgram(0);
+        gl_state_change(glBindVertexArray, 0);
+        gl_state_change(glUseProgram, 0);
 
-        ImGui::Render();
-        
         // Render GUI if enabled
-        if (showGUI) {
-            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        {
+            PROFILE_SCOPE(ProfileStage::GUI);
+            GpuPassScope gpuPass(GpuPass::GUI);
+            ImGui::Render();
+            if (showGUI) {
+                ImDrawData* drawData = ImGui::GetDrawData();
+                ImGui_ImplOpenGL3_RenderDrawData(drawData);
+
+                RenderStats& stats = GpuProfiler::get().stats;
+                for (int i = 0; i < drawData->CmdListsCount; i++)
+                    stats.drawCalls += drawData->CmdLists[i]->CmdBuffer.Size;
+                stats.vertices += drawData->TotalIdxCount;
+            }
+        }
+
+        if (recorder) {
+            recorder->capture();
+            if (recorder->frameCount() >= (std::size_t)offscreenOptions.frames)
+                glfwSetWindowShouldClose(window, GLFW_TRUE);
+        }
+        else {
+            glfwSwapBuffers(window);
+        }
+
+        // Time to the first frame, and to the first frame with every asset loaded
+        if (firstFrameMs == 0.0 || (interactiveMs == 0.0 && assets.finished())) {
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup).count();
+            if (firstFrameMs == 0.0) {
+                firstFrameMs = ms;
+                std::printf("First frame after %.1f ms\n", firstFrameMs);
+            }
+            if (assets.finished()) {
+                interactiveMs = ms;
+                std::printf("Interactive after %.1f ms (%zu assets)\n", interactiveMs, assets.assetCount());
+            }
         }
 
-        glfwSwapBuffers(window);
+        // Aggregate the timers of this frame for the profiler panel
+        Profiler::get().endFrame();
+        GpuProfiler::get().endFrame();
     }
 
+    if (recorder) {
+        std::size_t written = recorder->finish();
+        std::printf("Wrote %zu frames to %s\n", written, offscreenOptions.directory.c_str());
+        recorder.reset();
+    }
+
+    GpuProfiler::get().cleanup();
+
     // End ImGui processes
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
     // Clean-up
-    for (auto boid : boids) {
-		delete boid;
-	}
-
     for (auto obstacle : obstacles) {
 		delete obstacle;
 	}
@@ -678,8 +1073,8 @@ namespace {
                 camera->front = { 0.f, 0.f, -1.f };
             }
             else if (GLFW_KEY_4 == key && GLFW_PRESS == action) {
-                if (boidsCount != 0) {
-                    boidToFollow = rand() % boidsCount;
+                if (totalBoidsCount() != 0) {
+                    pickBoidToFollow = true;
 				    camera->mode = THIRD_PERSON;
                     camera->position.z = 10.f;
                 }
@@ -821,23 +1216,19 @@ namespace {
 					    glfwGetFramebufferSize(window, &nwidth, &nheight);
 					    float x = float(xPos) / float(nwidth);
 					    float y = float(yPos) / float(nheight);
-					    userInputLocation.x = x * 2 * SIMULATION_SIZE.x - SIMULATION_SIZE.x;
-					    userInputLocation.z = y * 2 * SIMULATION_SIZE.z - SIMULATION_SIZE.z;
-
-                        if (userInputLocation.x > SIMULATION_SIZE.x) userInputLocation.x = SIMULATION_SIZE.x;
-                        else if (userInputLocation.x < -SIMULATION_SIZE.x) userInputLocation.x = -SIMULATION_SIZE.x;
-                
-                        if (userInputLocation.z > SIMULATION_SIZE.z) userInputLocation.z = SIMULATION_SIZE.z;
-                        else if (userInputLocation.z < -SIMULATION_SIZE.z) userInputLocation.z = -SIMULATION_SIZE.z;
+					    userInputLocation.x = x * simulationBounds.size().x + simulationBounds.min.x;
+					    userInputLocation.z = y * simulationBounds.size().z + simulationBounds.min.z;
+
+                        userInputLocation.x = clamp(userInputLocation.x, simulationBounds.min.x, simulationBounds.max.x);
+                        userInputLocation.z = clamp(userInputLocation.z, simulationBounds.min.z, simulationBounds.max.z);
                     }
                     // If left click is pressed, change userInputLocation on Y axis
                     else if (leftClick) {
                         int nwidth, nheight;
                         glfwGetFramebufferSize(window, &nwidth, &nheight);
                         float y = float(yPos) / float(nheight);
-                        userInputLocation.y = y * -50.f + 50.f;
-                        if (userInputLocation.y > 50.f) userInputLocation.y = 50.f;
-                        else if (userInputLocation.y < 0.f) userInputLocation.y = 0.f;
+                        userInputLocation.y = y * -simulationBounds.size().y + simulationBounds.max.y;
+                        userInputLocation.y = clamp(userInputLocation.y, simulationBounds.min.y, simulationBounds.max.y);
                     }
 	        }
             }
@@ -0,0 +1,144 @@
+#include "batch.hpp"
+
+#include <cstdint>
+
+namespace
+{
+	Vec3f& at(Vec3f* first, std::size_t index, std::size_t stride) noexcept
+	{
+		return *reinterpret_cast<Vec3f*>(reinterpret_cast<std::uint8_t*>(first) + index * stride);
+	}
+
+#if defined(MATH_SIMD)
+	// Splits four packed Vec3f (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3) into one register per axis
+	void deinterleave(__m128 a, __m128 b, __m128 c, __m128& x, __m128& y, __m128& z) noexcept
+	{
+		__m128 const x2y2x3y3 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));
+		__m128 const y0z0y1z1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1));
+		x = _mm_shuffle_ps(a, x2y2x3y3, _MM_SHUFFLE(2, 0, 3, 0));
+		y = _mm_shuffle_ps(y0z0y1z1, x2y2x3y3, _MM_SHUFFLE(3, 1, 2, 0));
+		z = _mm_shuffle_ps(y0z0y1z1, c, _MM_SHUFFLE(3, 0, 3, 1));
+	}
+
+	// Inverse of deinterleave
+	void interleave(__m128 x, __m128 y, __m128 z, __m128& a, __m128& b, __m128& c) noexcept
+	{
+		__m128 const x0y0x1y1 = _mm_unpacklo_ps(x, y);
+		__m128 const x2y2x3y3 = _mm_unpackhi_ps(x, y);
+		__m128 const z0z0x1x1 = _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0));
+		__m128 const y1y1z1z1 = _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 const z2z2x3x3 = _mm_shuffle_ps(z, x2y2x3y3, _MM_SHUFFLE(2, 2, 2, 2));
+		__m128 const y3y3z3z3 = _mm_shuffle_ps(x2y2x3y3, z, _MM_SHUFFLE(3, 3, 3, 3));
+		a = _mm_shuffle_ps(x0y0x1y1, z0z0x1x1, _MM_SHUFFLE(2, 0, 1, 0));
+		b = _mm_shuffle_ps(y1y1z1z1, x2y2x3y3, _MM_SHUFFLE(1, 0, 2, 0));
+		c = _mm_shuffle_ps(z2z2x3x3, y3y3z3z3, _MM_SHUFFLE(2, 0, 2, 0));
+	}
+
+	// 1 / sqrt with one Newton-Raphson step, 0 for null lengths so that null vectors stay null
+	__m128 rsqrt_or_zero(__m128 lengthSquared) noexcept
+	{
+		__m128 r = _mm_rsqrt_ps(lengthSquared);
+		r = _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(1.5f),
+			_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), lengthSquared), _mm_mul_ps(r, r))));
+		return _mm_and_ps(r, _mm_cmpneq_ps(lengthSquared, _mm_setzero_ps()));
+	}
+#endif
+
+	// Applies the 3x4 row-major affine transform m (linear part and translation) to every vector
+	void transform_affine(float const (&m)[12], Vec3f* vectors, std::size_t count, std::size_t stride) noexcept
+	{
+		std::size_t i = 0;
+#if defined(MATH_SIMD)
+		if (stride == sizeof(Vec3f)) {
+			// Four vectors per iteration, one register per axis
+			__m128 M[12];
+			for (int k = 0; k < 12; k++)
+				M[k] = _mm_set1_ps(m[k]);
+
+			float* data = &vectors->x;
+			for (; i + 4 <= count; i += 4, data += 12) {
+				__m128 x, y, z;
+				deinterleave(_mm_loadu_ps(data), _mm_loadu_ps(data + 4), _mm_loadu_ps(data + 8), x, y, z);
+				__m128 const tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(M[0], x), _mm_mul_ps(M[1], y)), _mm_add_ps(_mm_mul_ps(M[2], z), M[3]));
+				__m128 const ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(M[4], x), _mm_mul_ps(M[5], y)), _mm_add_ps(_mm_mul_ps(M[6], z), M[7]));
+				__m128 const tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(M[8], x), _mm_mul_ps(M[9], y)), _mm_add_ps(_mm_mul_ps(M[10], z), M[11]));
+				__m128 a, b, c;
+				interleave(tx, ty, tz, a, b, c);
+				_mm_storeu_ps(data, a);
+				_mm_storeu_ps(data + 4, b);
+				_mm_storeu_ps(data + 8, c);
+			}
+		}
+
+		// One vector per iteration: result = column0 * x + column1 * y + column2 * z + translation
+		__m128 const c0 = _mm_setr_ps(m[0], m[4], m[8], 0.f);
+		__m128 const c1 = _mm_setr_ps(m[1], m[5], m[9], 0.f);
+		__m128 const c2 = _mm_setr_ps(m[2], m[6], m[10], 0.f);
+		__m128 const c3 = _mm_setr_ps(m[3], m[7], m[11], 0.f);
+		for (; i < count; i++) {
+			Vec3f& v = at(vectors, i, stride);
+			__m128 const t = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v.x)), _mm_mul_ps(c1, _mm_set1_ps(v.y))),
+				_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(v.z)), c3));
+			_mm_storel_pi(reinterpret_cast<__m64*>(&v.x), t);
+			_mm_store_ss(&v.z, _mm_movehl_ps(t, t));
+		}
+#else
+		for (; i < count; i++) {
+			Vec3f& v = at(vectors, i, stride);
+			v = Vec3f{
+				m[0] * v.x + m[1] * v.y + m[2] * v.z + m[3],
+				m[4] * v.x + m[5] * v.y + m[6] * v.z + m[7],
+				m[8] * v.x + m[9] * v.y + m[10] * v.z + m[11]
+			};
+		}
+#endif
+	}
+}
+
+void transform_points(Mat44f const& matrix, Vec3f* points, std::size_t count, std::size_t stride) noexcept
+{
+	float const m[12] = {
+		matrix(0, 0), matrix(0, 1), matrix(0, 2), matrix(0, 3),
+		matrix(1, 0), matrix(1, 1), matrix(1, 2), matrix(1, 3),
+		matrix(2, 0), matrix(2, 1), matrix(2, 2), matrix(2, 3)
+	};
+	transform_affine(m, points, count, stride);
+}
+
+void transform_vectors(Mat33f const& matrix, Vec3f* vectors, std::size_t count, std::size_t stride) noexcept
+{
+	float const m[12] = {
+		matrix(0, 0), matrix(0, 1), matrix(0, 2), 0.f,
+		matrix(1, 0), matrix(1, 1), matrix(1, 2), 0.f,
+		matrix(2, 0), matrix(2, 1), matrix(2, 2), 0.f
+	};
+	transform_affine(m, vectors, count, stride);
+}
+
+void normalize_vectors(Vec3f* vectors, std::size_t count, std::size_t stride) noexcept
+{
+	std::size_t i = 0;
+#if defined(MATH_SIMD)
+	if (stride == sizeof(Vec3f)) {
+		float* data = &vectors->x;
+		for (; i + 4 <= count; i += 4, data += 12) {
+			__m128 const a = _mm_loadu_ps(data);
+			__m128 const b = _mm_loadu_ps(data + 4);
+			__m128 const c = _mm_loadu_ps(data + 8);
+			__m128 x, y, z;
+			deinterleave(a, b, c, x, y, z);
+			__m128 const s = rsqrt_or_zero(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+
+			// Scale the packed vectors directly: s0 s0 s0 s1 | s1 s1 s2 s2 | s2 s3 s3 s3
+			_mm_storeu_ps(data, _mm_mul_ps(a, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 0, 0))));
+			_mm_storeu_ps(data + 4, _mm_mul_ps(b, _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 2, 1, 1))));
+			_mm_storeu_ps(data + 8, _mm_mul_ps(c, _mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 2))));
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		Vec3f& v = at(vectors, i, stride);
+		v = normalize_fast(v);
+	}
+}
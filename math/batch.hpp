@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+
+#include "vec3.hpp"
+#include "mat33.hpp"
+#include "mat44.hpp"
+
+// Batch variants of the vector and matrix functions. They work in place on count vectors
+// that are stride bytes apart, so they can run directly over the positions or normals of
+// an array of vertices. Contiguous arrays (stride == sizeof(Vec3f)) take a faster path
+// that processes four vectors per iteration with the SIMD backends.
+
+/**
+* @brief Transforms points by an affine matrix (the bottom row is assumed to be 0, 0, 0, 1).
+*
+* @param matrix - The affine transform.
+* @param points - Pointer to the first point.
+* @param count - The number of points.
+* @param stride - The distance in bytes between two points.
+*
+* @return void
+*/
+void transform_points(Mat44f const&, Vec3f*, std::size_t, std::size_t stride = sizeof(Vec3f)) noexcept;
+
+/**
+* @brief Transforms direction vectors by a 3x3 matrix, e.g. normals by the normal matrix.
+*
+* @param matrix - The transform.
+* @param vectors - Pointer to the first vector.
+* @param count - The number of vectors.
+* @param stride - The distance in bytes between two vectors.
+*
+* @return void
+*/
+void transform_vectors(Mat33f const&, Vec3f*, std::size_t, std::size_t stride = sizeof(Vec3f)) noexcept;
+
+/**
+* @brief Normalizes vectors with the fast reciprocal square root. Null vectors are left unchanged.
+*
+* @param vectors - Pointer to the first vector.
+* @param count - The number of vectors.
+* @param stride - The distance in bytes between two vectors.
+*
+* @return void
+*/
+void normalize_vectors(Vec3f*, std::size_t, std::size_t stride = sizeof(Vec3f)) noexcept;
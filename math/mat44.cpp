@@ -66,3 +66,52 @@ Mat44f invert( Mat44f const& Matrix ) noexcept
 	return result;
 }
 
+
+namespace
+{
+	Vec3f const& at(Vec3f const* first, std::size_t index, std::size_t stride) noexcept
+	{
+		return *reinterpret_cast<Vec3f const*>(reinterpret_cast<unsigned char const*>(first) + index * stride);
+	}
+
+	// Writes the three rows of one model matrix to out (row pitch 4 floats)
+	void make_model_rows(Vec3f position, Vec3f d, float tailShear, float* out) noexcept
+	{
+		// Rodrigues' formula for the shortest rotation from +X to d, k = X x d = (0, -d.z, d.y), c = X . d:
+		// R = I + [k]x + [k]x^2 / (1 + c). Past 90 degrees (c < 0) the boids use the rotation from -X
+		// to d followed by a half turn around Y instead, which only flips the signs marked with s.
+		float const s = d.x < 0.f ? -1.f : 1.f;
+		float const h = 1.f / (1.f + s * d.x);
+		float const r00 = s * (1.f - h * (d.y * d.y + d.z * d.z));
+		float const r11 = 1.f - h * d.y * d.y;
+		float const r22 = s * (1.f - h * d.z * d.z);
+		float const r12 = -s * h * d.y * d.z;
+		float const r21 = -h * d.y * d.z;
+
+		// Column 0 of R * shear = column 0 + tailShear * column 2
+		out[0] = r00 - tailShear * d.z;	out[1] = -s * d.y;	out[2] = -d.z;	out[3] = position.x;
+		out[4] = d.y + tailShear * r12;	out[5] = r11;		out[6] = r12;	out[7] = position.y;
+		out[8] = d.z + tailShear * r22;	out[9] = r21;		out[10] = r22;	out[11] = position.z;
+	}
+}
+
+void make_model_matrices(Vec3f const* positions, Vec3f const* directions, std::size_t count,
+	float tailShear, Mat34f* out, std::size_t stride, std::size_t outStride) noexcept
+{
+	unsigned char* destination = reinterpret_cast<unsigned char*>(out);
+	for (std::size_t i = 0; i < count; i++)
+		make_model_rows(at(positions, i, stride), at(directions, i, stride), tailShear,
+			reinterpret_cast<Mat34f*>(destination + i * outStride)->v);
+}
+
+void make_model_matrices(Vec3f const* positions, Vec3f const* directions, std::size_t count,
+	float tailShear, Mat44f* out, std::size_t stride) noexcept
+{
+	for (std::size_t i = 0; i < count; i++) {
+		make_model_rows(at(positions, i, stride), at(directions, i, stride), tailShear, out[i].v);
+		out[i](3, 0) = 0.f;
+		out[i](3, 1) = 0.f;
+		out[i](3, 2) = 0.f;
+		out[i](3, 3) = 1.f;
+	}
+}
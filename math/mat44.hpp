@@ -11,9 +11,10 @@
 
 #include "vec3.hpp"
 #include "vec4.hpp"
+#include "simd.hpp"
 
-// Mat44f: 4x4 matrix with floats
-struct Mat44f
+// Mat44f: 4x4 row-major matrix with floats, aligned so that each row is a SIMD load
+struct alignas(16) Mat44f
 {
 	float v[16];
 
@@ -31,6 +32,26 @@ struct Mat44f
 	}
 };
 
+// Mat34f: compact affine transform, the first three rows of a Mat44f whose last row is 0, 0, 0, 1.
+// Tightly packed, so an array of them can be uploaded as-is to a GL instance buffer (3 vec4 rows).
+struct alignas(16) Mat34f
+{
+	float v[12];
+
+	constexpr
+		float& operator() (std::size_t aI, std::size_t aJ) noexcept
+	{
+		assert(aI < 3 && aJ < 4);
+		return v[aI * 4 + aJ];
+	}
+	constexpr
+		float const& operator() (std::size_t aI, std::size_t aJ) const noexcept
+	{
+		assert(aI < 3 && aJ < 4);
+		return v[aI * 4 + aJ];
+	}
+};
+
 // Identity matrix
 constexpr Mat44f Identity44f = { {
 	1.f, 0.f, 0.f, 0.f,
@@ -40,10 +61,39 @@ constexpr Mat44f Identity44f = { {
 } };
 
 // Common operators for Mat44f:
-constexpr
+inline
 Mat44f operator*(Mat44f const& leftSide, Mat44f const& rightSide) noexcept
 {
-	Mat44f result = {};
+	Mat44f result;
+#if defined(MATH_BACKEND_AVX)
+	// Two rows of the result at a time: row i = sum over k of leftSide(i, k) * row k of rightSide
+	__m256 const r0 = _mm256_broadcast_ps((__m128 const*)&rightSide.v[0]);
+	__m256 const r1 = _mm256_broadcast_ps((__m128 const*)&rightSide.v[4]);
+	__m256 const r2 = _mm256_broadcast_ps((__m128 const*)&rightSide.v[8]);
+	__m256 const r3 = _mm256_broadcast_ps((__m128 const*)&rightSide.v[12]);
+	for (int i = 0; i < 16; i += 8) {
+		__m256 const l = _mm256_loadu_ps(&leftSide.v[i]);
+		__m256 sum = _mm256_mul_ps(_mm256_shuffle_ps(l, l, 0x00), r0);
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_shuffle_ps(l, l, 0x55), r1));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_shuffle_ps(l, l, 0xAA), r2));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_shuffle_ps(l, l, 0xFF), r3));
+		_mm256_storeu_ps(&result.v[i], sum);
+	}
+#elif defined(MATH_BACKEND_SSE)
+	// Row i = sum over k of leftSide(i, k) * row k of rightSide
+	__m128 const r0 = _mm_load_ps(&rightSide.v[0]);
+	__m128 const r1 = _mm_load_ps(&rightSide.v[4]);
+	__m128 const r2 = _mm_load_ps(&rightSide.v[8]);
+	__m128 const r3 = _mm_load_ps(&rightSide.v[12]);
+	for (int i = 0; i < 16; i += 4) {
+		__m128 const l = _mm_load_ps(&leftSide.v[i]);
+		__m128 sum = _mm_mul_ps(_mm_shuffle_ps(l, l, 0x00), r0);
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(l, l, 0x55), r1));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(l, l, 0xAA), r2));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(l, l, 0xFF), r3));
+		_mm_store_ps(&result.v[i], sum);
+	}
+#else
 	float sum = 0;
 	for (int i = 0; i < 4; i++) {
 		for (int j = 0; j < 4; j++) {
@@ -54,13 +104,24 @@ Mat44f operator*(Mat44f const& leftSide, Mat44f const& rightSide) noexcept
 			result(i, j) = sum;
 		}
 	}
+#endif
 	return result;
 }
 
-constexpr
+inline
 Vec4f operator*(Mat44f const& leftSide, Vec4f const& rightSide) noexcept
 {
-	Vec4f result = {};
+	Vec4f result;
+#if defined(MATH_SIMD)
+	// Multiply every row by the vector, then sum the products of each row with a transpose
+	__m128 const v = _mm_load_ps(&rightSide.x);
+	__m128 p0 = _mm_mul_ps(_mm_load_ps(&leftSide.v[0]), v);
+	__m128 p1 = _mm_mul_ps(_mm_load_ps(&leftSide.v[4]), v);
+	__m128 p2 = _mm_mul_ps(_mm_load_ps(&leftSide.v[8]), v);
+	__m128 p3 = _mm_mul_ps(_mm_load_ps(&leftSide.v[12]), v);
+	_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+	_mm_store_ps(&result.x, _mm_add_ps(_mm_add_ps(p0, p1), _mm_add_ps(p2, p3)));
+#else
 	float sum = 0;
 	for (int i = 0; i < 4; i++) {
 		sum = 0;
@@ -69,31 +130,31 @@ Vec4f operator*(Mat44f const& leftSide, Vec4f const& rightSide) noexcept
 		}
 		result[i] = sum;
 	}
+#endif
 	return result;
 }
 
-constexpr
+inline
 Mat44f operator*=(Mat44f& leftSide, Mat44f const& rightSide) noexcept
 {
-	Mat44f result = {};
-	float sum = 0;
-	for (int i = 0; i < 4; i++) {
-		for (int j = 0; j < 4; j++) {
-			sum = 0;
-			for (int k = 0; k < 4; k++) {
-				sum += leftSide(i, k) * rightSide(k, j);
-			}
-			result(i, j) = sum;
-		}
-	}
-	for (int i = 0; i < 16; i++) {
-		leftSide.v[i] = result.v[i];
-	}
+	leftSide = leftSide * rightSide;
 	return leftSide;
 }
 
 Mat44f invert(Mat44f const& Matrix) noexcept;
 
+// Batch model matrices for objects modelled facing +X, e.g. the boids:
+// out[i] = make_translation(position) * rotation from +X to direction * make_shear_x(0, tailShear).
+// The rotation is the one the boids always used (shortest arc, mirrored around Y past 90 degrees
+// so the model never ends up upside down), built in closed form without trigonometry and with
+// the shear folded into the first column. Positions and directions (unit length) are read
+// stride bytes apart, so they can come from separate arrays or from an array of structs,
+// and the Mat34f are written outStride bytes apart, e.g. into an array of per-instance structs.
+void make_model_matrices(Vec3f const* positions, Vec3f const* directions, std::size_t count,
+	float tailShear, Mat34f* out, std::size_t stride = sizeof(Vec3f), std::size_t outStride = sizeof(Mat34f)) noexcept;
+void make_model_matrices(Vec3f const* positions, Vec3f const* directions, std::size_t count,
+	float tailShear, Mat44f* out, std::size_t stride = sizeof(Vec3f)) noexcept;
+
 // Functions:
 // Transposes a matrix
 inline
@@ -0,0 +1,42 @@
+#pragma once
+
+// Selects the SIMD backend of the math library at compile time.
+// One of MATH_BACKEND_SCALAR, MATH_BACKEND_SSE or MATH_BACKEND_AVX can be defined to force
+// a backend (premake5 --math-backend=scalar|sse|avx), otherwise the widest instruction set
+// enabled by the compiler flags is used. MATH_SIMD is defined for the SSE and AVX backends.
+#if !defined(MATH_BACKEND_SCALAR) && !defined(MATH_BACKEND_SSE) && !defined(MATH_BACKEND_AVX)
+#	if defined(__AVX__)
+#		define MATH_BACKEND_AVX 1
+#	elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#		define MATH_BACKEND_SSE 1
+#	else
+#		define MATH_BACKEND_SCALAR 1
+#	endif
+#endif
+
+#if defined(MATH_BACKEND_AVX)
+#	include <immintrin.h>
+#	define MATH_SIMD 1
+#elif defined(MATH_BACKEND_SSE)
+#	include <emmintrin.h>
+#	define MATH_SIMD 1
+#endif
+
+#include <cmath>
+
+/**
+* @brief Approximate 1 / sqrt(value), accurate to about 22 bits with the SIMD backends.
+*/
+inline
+float rsqrt_fast(float value) noexcept {
+#if defined(MATH_SIMD)
+	// Hardware estimate (12 bits) refined with one Newton-Raphson step: r * (1.5 - 0.5 * x * r * r)
+	__m128 const x = _mm_set_ss(value);
+	__m128 r = _mm_rsqrt_ss(x);
+	__m128 const rr = _mm_mul_ss(r, r);
+	r = _mm_mul_ss(r, _mm_sub_ss(_mm_set_ss(1.5f), _mm_mul_ss(_mm_mul_ss(_mm_set_ss(0.5f), x), rr)));
+	return _mm_cvtss_f32(r);
+#else
+	return 1.f / std::sqrt(value);
+#endif
+}
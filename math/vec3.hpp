@@ -10,6 +10,7 @@
 #include <cstdlib>
 
 #include "other.hpp"
+#include "simd.hpp"
 
 // Vec3f: 3D vector with floats
 struct Vec3f {
@@ -147,6 +148,16 @@ Vec3f normalize( Vec3f vector ) noexcept {
 	return vector / l;
 }
 
+// Normalize a vector using the fast reciprocal square root, return the same vector if it's a null vector
+inline
+Vec3f normalize_fast( Vec3f vector ) noexcept {
+	float const l2 = dot( vector, vector );
+	if( l2 == 0.f )
+		return vector;
+
+	return vector * rsqrt_fast( l2 );
+}
+
 // Clamp a vector between two values
 inline
 Vec3f clamp_vec(Vec3f vector, float min, float max) noexcept {
@@ -9,8 +9,10 @@
 #include <cassert>
 #include <cstdlib>
 
-// Vec2f: 4D vector with floats
-struct Vec4f
+#include "simd.hpp"
+
+// Vec4f: 4D vector with floats, aligned for SIMD loads
+struct alignas(16) Vec4f
 {
 	float x, y, z, w;
 
@@ -140,9 +142,47 @@ float dot( Vec4f leftSide, Vec4f rightSide ) noexcept
 		+ leftSide.w * rightSide.w;
 }
 
-// Cross product of two vectors
+// Length of a vector
 inline
 float length( Vec4f vector ) noexcept
 {
 	return std::sqrt( dot( vector, vector ) );
 }
+
+// Normalize a vector, return the same vector if it's a null vector
+inline
+Vec4f normalize( Vec4f vector ) noexcept
+{
+	float const l2 = dot( vector, vector );
+	if( l2 == 0.f )
+		return vector;
+
+	return vector / std::sqrt( l2 );
+}
+
+// Normalize a vector using the fast reciprocal square root, return the same vector if it's a null vector
+inline
+Vec4f normalize_fast( Vec4f vector ) noexcept
+{
+#if defined(MATH_SIMD)
+	__m128 const v = _mm_load_ps( &vector.x );
+	__m128 l2 = _mm_mul_ps( v, v );
+	l2 = _mm_add_ps( l2, _mm_shuffle_ps( l2, l2, _MM_SHUFFLE(2, 3, 0, 1) ) );
+	l2 = _mm_add_ps( l2, _mm_shuffle_ps( l2, l2, _MM_SHUFFLE(1, 0, 3, 2) ) );
+	if( _mm_cvtss_f32( l2 ) == 0.f )
+		return vector;
+
+	// Estimate refined with one Newton-Raphson step, as in rsqrt_fast
+	__m128 r = _mm_rsqrt_ps( l2 );
+	r = _mm_mul_ps( r, _mm_sub_ps( _mm_set1_ps( 1.5f ), _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( 0.5f ), l2 ), _mm_mul_ps( r, r ) ) ) );
+	Vec4f result;
+	_mm_store_ps( &result.x, _mm_mul_ps( v, r ) );
+	return result;
+#else
+	float const l2 = dot( vector, vector );
+	if( l2 == 0.f )
+		return vector;
+
+	return vector * rsqrt_fast( l2 );
+#endif
+}
@@ -1,3 +1,16 @@
+newoption {
+	trigger = "math-backend",
+	value = "BACKEND",
+	description = "SIMD backend of the math library",
+	allowed = {
+		{ "auto", "Widest instruction set enabled by the compiler flags" },
+		{ "scalar", "Plain C++" },
+		{ "sse", "SSE2" },
+		{ "avx", "AVX" }
+	},
+	default = "auto"
+}
+
 workspace "Boids-Simulation"
 	language "C++"
 	cppdialect "C++17"
@@ -30,6 +43,19 @@ workspace "Boids-Simulation"
 	
 	filter "*"
 
+	-- math backend, see math/simd.hpp
+	filter "options:math-backend=scalar"
+		defines { "MATH_BACKEND_SCALAR=1" }
+
+	filter "options:math-backend=sse"
+		defines { "MATH_BACKEND_SSE=1" }
+
+	filter "options:math-backend=avx"
+		defines { "MATH_BACKEND_AVX=1" }
+		vectorextensions "AVX"
+
+	filter "*"
+
 	-- default libraries
 	filter "system:linux"
 		links "dl"